@@ -1,3 +1,6 @@
+#ifndef BITOPS_H
+#define BITOPS_H
+
 #ifdef CONFIG_64BIT
 #define BITS_PER_LONG 64
 #else
@@ -35,3 +38,51 @@
 #define NBITS(n) (n==0?0:NBITS32(n))
 
 #define EXTRACT_NBITS(nr, h, l) ((nr&GENMASK(h,l)) >> l)
+
+/*
+ * Bitmaps as arrays of 64-bit words, bit @nr lives in word
+ * BIT_ULL_WORD(nr)
+ */
+#define BITS_PER_LONG_LONG      64
+#define BITS_TO_ULLS(nr)        DIV_ROUND_UP(nr, BITS_PER_LONG_LONG)
+
+static inline void set_bit_ull(int nr, unsigned long long *map)
+{
+	map[BIT_ULL_WORD(nr)] |= BIT_ULL_MASK(nr);
+}
+
+static inline void clear_bit_ull(int nr, unsigned long long *map)
+{
+	map[BIT_ULL_WORD(nr)] &= ~BIT_ULL_MASK(nr);
+}
+
+static inline int test_bit_ull(int nr, const unsigned long long *map)
+{
+	return (map[BIT_ULL_WORD(nr)] & BIT_ULL_MASK(nr)) != 0;
+}
+
+/* Index of the first set bit at or after @start, @nbits if none */
+static inline int find_next_bit_ull(const unsigned long long *map,
+		int nbits, int start)
+{
+	int word = BIT_ULL_WORD(start);
+	unsigned long long bits;
+
+	if (start >= nbits)
+		return nbits;
+	bits = map[word] & (~0ULL << (start % BITS_PER_LONG_LONG));
+	while (bits == 0) {
+		if (++word >= BITS_TO_ULLS(nbits))
+			return nbits;
+		bits = map[word];
+	}
+	start = word * BITS_PER_LONG_LONG + __builtin_ctzll(bits);
+	return start < nbits ? start : nbits;
+}
+
+static inline int find_first_bit_ull(const unsigned long long *map, int nbits)
+{
+	return find_next_bit_ull(map, nbits, 0);
+}
+
+#endif /* BITOPS_H */
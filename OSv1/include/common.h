@@ -4,6 +4,7 @@
 /* Define structs and routine could be used by every source files */
 
 #include <stdint.h>
+#include <stdatomic.h>
 
 #ifndef OSCFG_H
 #include "os-cfg.h"
@@ -13,6 +14,8 @@
 #include "os-mm.h"
 #endif
 
+#include "pheap.h"
+
 #define ADDRESS_SIZE	20
 #define OFFSET_LEN	10
 #define FIRST_LV_LEN	5
@@ -28,7 +31,16 @@ enum ins_opcode_t {
 	ALLOC,	// Allocate memory
 	FREE,	// Deallocated a memory block
 	READ,	// Write data to a byte on memory
-	WRITE	// Read data from a byte on memory
+	WRITE,	// Read data from a byte on memory
+	LOCK,	// Take a lock, block while another process holds it
+	UNLOCK,	// Release a lock
+	SEM_WAIT,	// Decrement a semaphore, block while it is 0
+	SEM_POST,	// Increment a semaphore
+	IO,	// Issue a request to a device, block until it completes
+	SLEEP,	// Leave the CPU for a number of slots
+	READB,	// Read a block of bytes from memory
+	MEMSET,	// Write a byte to a block of memory
+	MEMCPY	// Copy a block of memory to another
 };
 
 /* instructions executed by the CPU */
@@ -37,10 +49,44 @@ struct inst_t {
 	uint32_t arg_0; // Argument lists for instructions
 	uint32_t arg_1;
 	uint32_t arg_2;
+	uint32_t arg_3;
+};
+
+struct pcb_t;
+struct dec_inst_t;
+
+/* Handler of a decoded instruction, it returns what run returns */
+typedef int (*exec_t)(struct pcb_t * proc, const struct dec_inst_t * ins);
+
+/* An instruction decoded once at load time: the handler which executes
+ * it and its operands. A memory instruction also holds the hook of the
+ * memory backend, so that its handler calls the backend directly */
+struct dec_inst_t {
+	exec_t exec;
+	union {
+		int (*alloc)(struct pcb_t * proc, uint32_t size,
+			uint32_t reg_index);
+		int (*free)(struct pcb_t * proc, uint32_t reg_index);
+		int (*read)(struct pcb_t * proc, uint32_t source,
+			uint32_t offset, uint32_t destination);
+		int (*write)(struct pcb_t * proc, BYTE data,
+			uint32_t destination, uint32_t offset);
+		int (*readb)(struct pcb_t * proc, uint32_t source,
+			uint32_t offset, uint32_t destination, uint32_t size);
+		int (*fill)(struct pcb_t * proc, BYTE data,
+			uint32_t destination, uint32_t offset, uint32_t size);
+		int (*copy)(struct pcb_t * proc, uint32_t source,
+			uint32_t destination, uint32_t size);
+	} mem;
+	uint32_t arg_0;
+	uint32_t arg_1;
+	uint32_t arg_2;
+	uint32_t arg_3;
 };
 
 struct code_seg_t {
 	struct inst_t * text;
+	struct dec_inst_t * ops;	// [text] decoded, run executes these
 	uint32_t size;
 };
 
@@ -70,11 +116,35 @@ struct pcb_t {
 	struct code_seg_t * code;	// Code segment
 	addr_t regs[10]; // Registers, store address of allocated regions
 	uint32_t pc; // Program pointer, point to the next instruction
-#ifdef MLQ_SCHED
+	uint64_t arrival; // Time slot in which the process was loaded
+	int last_cpu; // CPU which ran the process last, -1 if none yet
+	/* Accounting of the scheduler, in time slots */
+	uint64_t ready_since; // Slot in which the process entered ready queue
+	uint64_t wait_time; // Slots spent in ready queue
+	uint64_t run_time; // Slots spent on a CPU
+	uint64_t first_dispatch; // Slot of the first dispatch
+	uint64_t completion; // Slot in which the process finished
+	uint64_t deadline; // Slot by which the process has to finish, 0 if none
+	uint64_t blocked_since; // Slot in which the process last blocked
+	uint64_t block_time; // Slots spent blocked on kernel objects, I/O or sleep
+	uint32_t io_latency; // Slots the pending I/O request takes
+	atomic_int leaving; // Blocked but still on its CPU, 2 once released
+	int expired; // Its last step on a CPU used up the rest of its quantum
+	uint32_t nr_switches; // Times the process was dispatched
+	uint32_t nr_migrations; // Dispatches on another CPU than the last one
+	/* State of the scheduler policies */
+	uint64_t vruntime; // CFS: weighted run time
+	struct pheap_node run_node; // CFS, EDF, stride: node in the queue
+	int level; // MLFQ: current level, 0 is the top
+	int yielded; // MLFQ: left the CPU before the end of its quantum
+	uint32_t tickets; // Stride, lottery: share of the CPUs
+	uint64_t pass; // Stride: virtual time of the next dispatch
+	double share_start; // Stride, lottery: slots entitled per ticket at arrival
+	double share_blocked; // Stride, lottery: slots entitled per ticket when it blocked
+	uint64_t work_start; // Stride, lottery: slots handed out at arrival
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;     
-#endif
 #ifdef CPU_TLB
 	struct memphy_struct *tlb;
 #endif
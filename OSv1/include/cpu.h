@@ -4,8 +4,41 @@
 
 #include "common.h"
 
+/* Outcomes of run besides success and failure */
+#define RUN_BLOCKED	2	// The process blocks or sleeps
+#define RUN_WOKE	3	// The process has made a blocked process ready
+
+/* Decode the text of [code] into its handlers. The loader does it once
+ * for every program */
+void decode(struct code_seg_t * code);
+
+/* Pick the memory backend decode binds the memory instructions to:
+ * "tlb", "paging" or "legacy". Return -1 if [name] is unknown. The
+ * default is the first one the build supports in that order */
+int set_mem_backend(const char * name);
+
+/* Name of the memory backend */
+const char * mem_backend_name(void);
+
+/* Init the memory backend, before the first process is loaded */
+void init_mem_backend(void);
+
+/* Time every memory instruction decoded from now on */
+void mem_account(int enable);
+
+/* Print the number and the host time of the memory instructions */
+void print_mem_stat(void);
+
+/* Return 1 if the next instruction of [proc] touches no state shared
+ * with other CPUs: a CALC, or a READ or WRITE on the tlb backend whose
+ * page is in the TLB of the CPU running [proc], as long as the access
+ * dumps of os-cfg.h are off. Checking the TLB still takes its lock, so
+ * a batch is not lock-free */
+int run_local(struct pcb_t * proc);
+
 /* Execute an instruction of a process. Return 0
- * if the instruction is executed successfully.
+ * if the instruction is executed successfully,
+ * RUN_BLOCKED or RUN_WOKE if it did so with that outcome.
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
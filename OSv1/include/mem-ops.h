@@ -0,0 +1,41 @@
+
+#ifndef MEM_OPS_H
+#define MEM_OPS_H
+
+#include "common.h"
+
+/* A memory backend, chosen at run time with set_mem_backend. Its hooks
+ * carry out the memory instructions and return what run returns. [init]
+ * may be NULL */
+struct mem_ops {
+	const char * name;
+	void (*init)(void);
+	int (*alloc)(struct pcb_t * proc, uint32_t size, uint32_t reg_index);
+	int (*free)(struct pcb_t * proc, uint32_t reg_index);
+	int (*read)(struct pcb_t * proc, uint32_t source, uint32_t offset,
+		uint32_t destination);
+	int (*write)(struct pcb_t * proc, BYTE data, uint32_t destination,
+		uint32_t offset);
+	/* READB, MEMSET and MEMCPY on [size] bytes, translating once per
+	 * page. [readb] leaves the last byte in [destination], [copy]
+	 * copies the start of [source] to the start of [destination] */
+	int (*readb)(struct pcb_t * proc, uint32_t source, uint32_t offset,
+		uint32_t destination, uint32_t size);
+	int (*fill)(struct pcb_t * proc, BYTE data, uint32_t destination,
+		uint32_t offset, uint32_t size);
+	int (*copy)(struct pcb_t * proc, uint32_t source,
+		uint32_t destination, uint32_t size);
+};
+
+/* Legacy segmentation of mem.c */
+extern struct mem_ops legacy_mem_ops;
+#ifdef MM_PAGING
+/* Page tables of mm-vm.c */
+extern struct mem_ops paging_mem_ops;
+#endif
+#ifdef CPU_TLB
+/* Page tables behind the per-CPU TLB of cpu-tlb.c */
+extern struct mem_ops tlb_mem_ops;
+#endif
+
+#endif
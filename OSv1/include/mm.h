@@ -96,6 +96,7 @@
 
 #define RAM_LCK 0
 #define SWP_LCK 1
+#define NO_LCK 2 /* A frame of the caller, which nobody else touches */
 /* VM region prototypes */
 struct vm_rg_struct * init_vm_rg(int rg_start, int rg_endi);
 int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct* rgnode);
@@ -119,6 +120,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, uint32_t *alloc
 int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value);
+long __rg_addr(struct pcb_t *caller, int rgid, uint32_t offset, uint32_t size);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
 
 /* CPUTLB prototypes */
@@ -128,6 +130,10 @@ int tlballoc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
 int tlbfree_data(struct pcb_t *proc, uint32_t reg_index);
 int tlbread(struct pcb_t * proc, uint32_t source, uint32_t offset, uint32_t destination) ;
 int tlbwrite(struct pcb_t * proc, BYTE data, uint32_t destination, uint32_t offset);
+int tlbreadb(struct pcb_t *proc, uint32_t source, uint32_t offset, uint32_t destination, uint32_t size);
+int tlbmemset(struct pcb_t *proc, BYTE data, uint32_t destination, uint32_t offset, uint32_t size);
+int tlbmemcpy(struct pcb_t *proc, uint32_t source, uint32_t destination, uint32_t size);
+int tlb_hit(struct pcb_t *proc, uint32_t reg, uint32_t offset);
 int init_tlbmemphy(struct memphy_struct *mp, int max_size);
 int TLBMEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int TLBMEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
@@ -135,6 +141,9 @@ int TLBMEMPHY_dump(struct memphy_struct * mp, int pid, int pgnum);
 int tlb_cache_read(struct memphy_struct * mp, int pid, int pgnum, uint32_t *value);
 int tlb_cache_write(struct memphy_struct *mp, int pid, int pgnum, uint32_t value);
 int destroy_tlbmemphy(struct memphy_struct *mp);
+int tlb_shootdown(int pid, int pgnum, uint32_t value);
+unsigned long tlb_nr_shootdowns(void);
+void print_tlb_stat(void);
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
 int pgfree_data(struct pcb_t *proc, uint32_t reg_index);
@@ -148,6 +157,18 @@ int pgwrite(
 		BYTE data, // Data to be wrttien into memory
 		uint32_t destination, // Index of destination register
 		uint32_t offset);
+int pgreadb(struct pcb_t *proc, uint32_t source, uint32_t offset, uint32_t destination, uint32_t size);
+int pgmemset(struct pcb_t *proc, BYTE data, uint32_t destination, uint32_t offset, uint32_t size);
+int pgmemcpy(struct pcb_t *proc, uint32_t source, uint32_t destination, uint32_t size);
+/* Translation of page [pgn] to its frame: pg_getpage, or a TLB lookup in
+ * front of it. The block functions below translate once per page */
+typedef int (*getpage_t)(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller);
+int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller);
+int pg_getblk(struct mm_struct *mm, int addr, BYTE *buf, int size, struct pcb_t *caller, getpage_t getpage);
+int pg_putblk(struct mm_struct *mm, int addr, const BYTE *buf, int size, struct pcb_t *caller, getpage_t getpage);
+int pg_setblk(struct mm_struct *mm, int addr, BYTE value, int size, struct pcb_t *caller, getpage_t getpage);
+int pg_cpblk(struct mm_struct *mm, int dst, int src, int size, struct pcb_t *caller, getpage_t getpage);
+int __readb(struct pcb_t *caller, int addr, int size, BYTE *data, getpage_t getpage);
 /* Local VM prototypes */
 struct vm_rg_struct * get_symrg_byid(struct mm_struct* mm, int rgid);
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int vmaend);
@@ -164,6 +185,9 @@ int MEMPHY_pop_usedfp(struct memphy_struct *mp, int *fpn, int *pgn, struct mm_st
 int MEMPHY_put_usedfp(struct memphy_struct *mp, int fpn, struct mm_struct *owner, int pgn, BYTE option);
 int MEMPHY_read(struct memphy_struct *mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data, BYTE option);
+int MEMPHY_read_blk(struct memphy_struct *mp, int addr, BYTE *buf, int size, BYTE option);
+int MEMPHY_write_blk(struct memphy_struct *mp, int addr, const BYTE *buf, int size, BYTE option);
+int MEMPHY_set_blk(struct memphy_struct *mp, int addr, BYTE data, int size, BYTE option);
 int MEMPHY_dump(struct memphy_struct *mp, int fpn, int start, int end);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
 int destroy_memphy(struct memphy_struct *mp);
@@ -1,7 +1,6 @@
 #ifndef OSCFG_H
 #define OSCFG_H
 
-#define MLQ_SCHED 1
 #define MAX_PRIO 140
 
 #define CPU_TLB
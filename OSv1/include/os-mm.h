@@ -84,6 +84,9 @@ struct memphy_struct {
    struct framephy_struct *free_fp_list;
    struct framephy_struct *used_fp_list;
    struct framephy_struct *used_fp_tail;
+
+   /* TLB device: lock of its entries, see cpu-tlbcache.c */
+   struct tlb_lock *lock;
 };
 
 #endif
@@ -0,0 +1,40 @@
+
+#ifndef PHEAP_H
+#define PHEAP_H
+
+#include <stddef.h>
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Node of a pairing heap, embedded in the items of the heap */
+struct pheap_node {
+	struct pheap_node * child;	// Leftmost child
+	struct pheap_node * next;	// Right sibling
+};
+
+/* Return non-zero if [a] has to leave the heap before [b] */
+typedef int (*pheap_less_t)(struct pheap_node * a, struct pheap_node * b);
+
+/* Pairing heap: insertion in O(1), removal of the top in amortized
+ * O(log n) */
+struct pheap {
+	struct pheap_node * root;
+	pheap_less_t less;
+	int size;
+};
+
+void pheap_init(struct pheap * heap, pheap_less_t less);
+
+void pheap_insert(struct pheap * heap, struct pheap_node * node);
+
+/* Remove and return the top of [heap], NULL if it is empty */
+struct pheap_node * pheap_pop(struct pheap * heap);
+
+static inline struct pheap_node * pheap_top(struct pheap * heap)
+{
+	return heap->root;
+}
+
+#endif
+
@@ -4,18 +4,29 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 10
+/* Initial capacity of a queue, always a power of two */
+#define MIN_QUEUE_SIZE 16
 
+/* FIFO of processes on a ring buffer. The buffer doubles whenever it is
+ * full, so the queue never drops a process. A zeroed queue is empty */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
-	int size;
+	struct pcb_t ** proc;
+	int head;	// Index of the oldest process in [proc]
+	int size;	// Number of processes in the queue
+	int cap;	// Capacity of [proc], a power of two
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
 
 struct pcb_t * dequeue(struct queue_t * q);
 
+/* The oldest process of [q], left in the queue. NULL if [q] is empty */
+struct pcb_t * queue_head(struct queue_t * q);
+
 int empty(struct queue_t * q);
 
+/* Release the buffer of [q], which becomes an empty queue */
+void free_queue(struct queue_t * q);
+
 #endif
 
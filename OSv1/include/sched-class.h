@@ -0,0 +1,68 @@
+
+#ifndef SCHED_CLASS_H
+#define SCHED_CLASS_H
+
+#include "sched.h"
+#include <pthread.h>
+
+/* A scheduling policy, chosen at run time with set_scheduler. [get]
+ * returns NULL when CPU [cpu] has nothing to run. Every hook but [add],
+ * [put] and [get] may be NULL, without [wake] a woken process goes
+ * through [put] */
+struct sched_class {
+	const char * name;
+	void (*init)(int num_cpus);
+	void (*finish)(void);
+	/* Add a new process */
+	void (*add)(struct pcb_t * proc);
+	/* Put back a process preempted on CPU [cpu] */
+	void (*put)(int cpu, struct pcb_t * proc);
+	/* Process [proc] blocks on CPU [cpu] on a lock, an I/O or a sleep.
+	 * Called before anybody can wake it up */
+	void (*block)(int cpu, struct pcb_t * proc);
+	/* Put back a process woken on CPU [cpu] after a lock wait, an I/O
+	 * or a sleep */
+	void (*wake)(int cpu, struct pcb_t * proc);
+	/* Get the next process to run on CPU [cpu] */
+	struct pcb_t * (*get)(int cpu);
+	/* CPU [cpu] has run [proc] for [nr_slots] slots. Return 1 if [proc]
+	 * has to give up the CPU now */
+	int (*tick)(int cpu, struct pcb_t * proc, int nr_slots);
+	/* Process [proc] has finished on CPU [cpu] */
+	void (*exit)(int cpu, struct pcb_t * proc);
+	/* Print statistics of the policy */
+	void (*stats)(void);
+};
+
+extern struct sched_class fifo_sched_class;
+extern struct sched_class mlq_sched_class;
+extern struct sched_class mlq_percpu_sched_class;
+extern struct sched_class cfs_sched_class;
+extern struct sched_class mlfq_sched_class;
+extern struct sched_class edf_sched_class;
+extern struct sched_class stride_sched_class;
+extern struct sched_class lottery_sched_class;
+
+/* Dispatch statistics of a CPU */
+struct sched_stat {
+	unsigned long nr_gets;		// Calls of get_proc
+	unsigned long nr_dispatches;	// ... which returned a process
+	unsigned long dispatch_ns;	// Time spent in get_proc
+	unsigned long nr_steals;	// Processes taken from another CPU
+	unsigned long nr_migrations;	// Dispatches of a process last run elsewhere
+	unsigned long nr_affine;	// Dispatches moved ahead for affinity
+	unsigned long nr_lock_waits;	// Lock acquisitions that had to wait
+	unsigned long lock_wait_ns;
+};
+
+extern struct sched_stat * sched_stats;
+
+/* Affinity window of set_affinity */
+extern int sched_affinity;
+
+/* Take [lock] on behalf of CPU [cpu], accounting the time it waits.
+ * [cpu] is -1 for the loader */
+void sched_lock(pthread_mutex_t * lock, int cpu);
+
+#endif
+
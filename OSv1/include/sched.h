@@ -1,28 +1,98 @@
-#ifndef QUEUE_H
-#define QUEUE_H
 
+#ifndef SCHED_H
+#define SCHED_H
+
+/* The host pthread.h includes <sched.h>, which resolves to this file,
+ * so it must not use pthread types */
 #include "common.h"
 
-#ifndef MLQ_SCHED
-#define MLQ_SCHED
-#endif
+/* Select the policy named [name]. Return -1 if there is no such policy */
+int set_scheduler(const char * name);
 
-#define MAX_PRIO 139
+/* Set up the selected policy for CPUs with ID below [num_cpus] */
+void init_scheduler(int num_cpus);
+void finish_scheduler(void);
 
-int queue_empty(void);
+/* Let a CPU dispatch a process that last ran on it ahead of the one the
+ * policy would pick, as long as its priority is at most [window] levels
+ * worse. With 0, the default, the policy ignores where processes ran */
+void set_affinity(int window);
 
-void init_scheduler(void);
-void finish_scheduler(void);
+/* Time every get_proc from now on. Off by default, as two clock reads
+ * per dispatch are a fair part of a slot of the serial engine */
+void sched_account(int enable);
+
+/* Print dispatch, migration and lock wait counters of every CPU, the
+ * statistics of the policy, then the accounting of every process */
+void print_sched_stat(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Get the next process to run on CPU [cpu] from ready queue */
+struct pcb_t * get_proc(int cpu);
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Put a process preempted on CPU [cpu] back to run queue */
+void put_proc(int cpu, struct pcb_t * proc);
 
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
 
-#endif
+/* CPU [cpu] has run [proc] for [nr_slots] slots. Return 1 if [proc] has
+ * to give up the CPU at once */
+int sched_tick(int cpu, struct pcb_t * proc, int nr_slots);
+
+/* Process [proc] has finished on CPU [cpu], keep its accounting */
+void sched_exit(int cpu, struct pcb_t * proc);
+
+/* Kernel objects processes synchronize on. Locks and semaphores have
+ * separate IDs, below MAX_SYNC_OBJ. A lock starts free, a semaphore at 0
+ * unless set with sem_init */
+enum sync_type {
+	SYNC_LOCK,
+	SYNC_SEM
+};
+
+#define MAX_SYNC_OBJ	4096
+
+/* Start semaphore [id] at [value]. Return -1 if [id] is out of range */
+int sem_init(uint32_t id, int value);
 
+/* [proc], running on CPU [cpu], takes object [id]. Return 0 if it has
+ * got it, 1 if it has blocked in the wait queue of the object and has to
+ * leave the CPU, -1 on a bad ID or a lock [proc] holds already */
+int sync_wait(int cpu, struct pcb_t * proc, enum sync_type type, uint32_t id);
+
+/* [proc], running on CPU [cpu], releases object [id], which goes to the
+ * first process in its wait queue. Return 1 if that process has been put
+ * back to the ready queue, 0 if nobody was waiting, -1 on a bad ID or a
+ * lock [proc] does not hold */
+int sync_post(int cpu, struct pcb_t * proc, enum sync_type type, uint32_t id);
+
+/* CPU [cpu] has charged the slot to [proc], which blocked in it, and no
+ * longer runs it. If [proc] was released in the meantime it goes back to
+ * the ready queue now. Return 1 if so */
+int sched_release(int cpu, struct pcb_t * proc);
+
+/* Simulated devices, with IDs below MAX_IO_DEV. A device serves one
+ * request at a time, in FIFO order */
+#define MAX_IO_DEV	64
+
+/* [proc], running on CPU [cpu], issues a request of [latency] slots to
+ * device [dev] and blocks until it completes, then it is put back to the
+ * ready queue. Return 1, or -1 on a bad device */
+int io_submit(int cpu, struct pcb_t * proc, uint32_t dev, uint32_t latency);
+
+/* [proc], running on CPU [cpu], leaves the CPU for [slots] slots and is
+ * put back to the ready queue after that. The wakeup is a timer callback,
+ * so a sleeping process costs nothing per slot. Return 1, or 0 if [slots]
+ * is 0 and [proc] goes on */
+int sched_sleep(int cpu, struct pcb_t * proc, uint32_t slots);
+
+/* Call [fn] with the CPU a process last ran on whenever an I/O completion
+ * or the end of a sleep puts it back to the ready queue */
+void set_ready_notify(void (*fn)(int cpu));
+
+/* Return 1 if some process sleeps, waits on I/O or on an object that a
+ * live process may still release, so CPUs out of work must not stop yet */
+int sched_pending(void);
+
+#endif
 
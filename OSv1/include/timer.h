@@ -1,28 +1,84 @@
+
 #ifndef TIMER_H
 #define TIMER_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
+/* A device taking part in the clock. Every attached device must call
+ * next_slot once per time slot (or detach_event) before the clock moves
+ * on to the next slot */
 struct timer_id_t {
-	int done;
-	int fsh;
-	pthread_cond_t event_cond;
-	pthread_mutex_t event_lock;
-	pthread_cond_t timer_cond;
-	pthread_mutex_t timer_lock;
+	int fsh;	// Device has left the clock
+	int sense;	// Local sense of the device in the tick barrier
+	/* Sleep state, changed under sleep_lock of the clock */
+	uint64_t wake;	// Slot in which a sleeping device resumes
+	int busy;	// Device keeps working while it sleeps
+	/* Set by the device when it leaves the clock or by unpark_event,
+	 * cleared under tick_lock when the device is woken */
+	atomic_int asleep;	// Device sleeps through the slots before [wake]
+	pthread_cond_t wake_cond;
+	struct timer_id_t * next_sleeper;
 };
 
 void start_timer();
 
 void stop_timer();
 
+/* Attach a new device to the clock. A device attached while the clock
+ * runs joins it at the next slot: its thread must call wait_event before
+ * doing the job of its first slot */
 struct timer_id_t * attach_event();
 
+/* Block until [event] takes part in the current slot */
+void wait_event(struct timer_id_t * event);
+
 void detach_event(struct timer_id_t * event);
 
+/* [event] has done its job in the current slot and leaves the clock until
+ * unpark_event brings it back. Its thread must call wait_event before
+ * doing the job of its next slot */
+void park_event(struct timer_id_t * event);
+
+/* Bring parked [event] back to the clock from the next slot on. Only a
+ * device taking part in the current slot or a timer_at callback may call
+ * it. It may come before the park_event of the current slot, then
+ * [event] only sits out the rest of that slot */
+void unpark_event(struct timer_id_t * event);
+
 void next_slot(struct timer_id_t* timer_id);
 
+/* Wake time of a device that has nothing to do until another device
+ * hands it some work */
+#define TIMER_IDLE	UINT64_MAX
+
+/* Same as next_slot, but tells the clock that [timer_id] has nothing to
+ * do before slot [wake]: the device sleeps and takes no part in the slots
+ * in between. With [wake] = TIMER_IDLE the device still takes part in
+ * every slot. In event-driven mode the clock jumps over slots in which
+ * no device has work */
+void next_slot_until(struct timer_id_t* timer_id, uint64_t wake);
+
+/* Same as next_slot_until, but [timer_id] stays busy through the slots
+ * it sleeps, so the event-driven clock never skips them */
+void next_slot_busy(struct timer_id_t* timer_id, uint64_t wake);
+
+/* Call [fn]([arg]) once the clock has moved to slot [when], before any
+ * device does its job in that slot. [fn] runs on the thread that moves
+ * the clock, with no lock of the clock held, and may call timer_at and
+ * unpark_event. The event-driven clock never skips [when] */
+void timer_at(uint64_t when, void (*fn)(void * arg), void * arg);
+
+/* Enable or disable the event-driven (idle slot skipping) mode */
+void set_event_driven(int enable);
+
 uint64_t current_time();
 
+/* Print the number of ticks and the tick rate of the last run */
+void print_timer_stat(void);
+
+/* Host time the last run took, in seconds */
+double timer_elapsed(void);
+
 #endif
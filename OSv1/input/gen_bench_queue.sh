@@ -0,0 +1,22 @@
+#!/bin/sh
+# Write input/bench_queue_<NAME>: [N] copies of proc/s4 on 4 CPUs at
+# priority 0, all due in slot 0. The loader starts one process per slot, so
+# the ready queue only grows as fast as the CPUs fall behind and a run
+# times the whole simulator. For enqueue and dequeue alone, use
+# src/bench-queue.c. The 1k config is in the tree, the others are
+# generated, e.g. from OSv1/
+#	sh input/gen_bench_queue.sh 10 10
+#	sh input/gen_bench_queue.sh 100000 100k
+#	./os -s bench_queue_100k > /dev/null
+
+if [ $# -ne 2 ]; then
+	echo "usage: $0 N NAME" >&2
+	exit 1
+fi
+
+cd "$(dirname "$0")" || exit 1
+awk -v n="$1" 'BEGIN {
+	printf "2 4 %d\n1048576\n16777216 0 0 0\n", n
+	for (i = 0; i < n; i++)
+		print "0 s4 0"
+}' > "bench_queue_$2"
@@ -0,0 +1,61 @@
+
+/* Ready queue benchmark: time enqueue and dequeue on a queue of 10, 1k
+ * and 100k processes, without the rest of the simulator. "rotate" takes
+ * the oldest process and puts it back, as a CPU does at the end of its
+ * quantum, "fill/drain" enqueues all the processes and dequeues them
+ * again. Build it with "make bench_queue", then from OSv1/
+ *	./bench_queue 10000000
+ * for [n] operations of each kind per size */
+
+#include "queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double seconds(struct timespec * start, struct timespec * end) {
+	return (end->tv_sec - start->tv_sec)
+		+ (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char ** argv) {
+	static const int sizes[] = {10, 1000, 100000};
+	long n = argc > 1 ? atol(argv[1]) : 10000000, i, j;
+	struct timespec start, end;
+	unsigned k;
+	if (n <= 0) {
+		printf("Usage: bench_queue [N]\n");
+		return 1;
+	}
+	for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+		int size = sizes[k];
+		struct pcb_t * procs = calloc(size, sizeof(struct pcb_t));
+		struct queue_t q = {0};
+		long rounds = (n + 2 * size - 1) / (2 * size);
+		for (i = 0; i < size; i++)
+			enqueue(&q, &procs[i]);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < n / 2; i++)
+			enqueue(&q, dequeue(&q));
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		printf("%6d processes, rotate:     %5.1f ns per operation\n",
+			size, seconds(&start, &end) * 1e9 / (n / 2 * 2));
+
+		while (!empty(&q))
+			dequeue(&q);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < rounds; i++) {
+			for (j = 0; j < size; j++)
+				enqueue(&q, &procs[j]);
+			for (j = 0; j < size; j++)
+				dequeue(&q);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		printf("%6d processes, fill/drain: %5.1f ns per operation\n",
+			size, seconds(&start, &end) * 1e9 / (rounds * size * 2));
+
+		free_queue(&q);
+		free(procs);
+	}
+	return 0;
+}
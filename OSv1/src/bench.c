@@ -0,0 +1,65 @@
+
+/* Dispatch benchmark: load one program and execute [n] of its
+ * instructions with run(), wrapping around to the second instruction at
+ * the end, so that a leading alloc runs once. Build it with "make bench",
+ * then from OSv1/
+ *	./bench input/proc/bench_calc 10000000
+ *	./bench input/proc/bench_mix 10000000 tlb
+ * The per-access dumps of os-cfg.h (IODUMP, PAGETBL_DUMP, TLBDUMP) cost
+ * far more than the dispatch, comment them out for the mix */
+
+#include "cpu.h"
+#include "loader.h"
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int main(int argc, char ** argv) {
+	if (argc < 3) {
+		printf("Usage: bench PROGRAM N [tlb|paging|legacy]\n");
+		return 1;
+	}
+	if (argc > 3 && set_mem_backend(argv[3]) < 0) {
+		printf("Unknown memory backend '%s'\n", argv[3]);
+		return 1;
+	}
+	long n = atol(argv[2]), i;
+	struct timespec start, end;
+	init_mem_backend();
+#ifdef MM_PAGING
+	static struct memphy_struct mram, mswp[PAGING_MAX_MMSWP];
+	init_memphy(&mram, 0x100000, 1);
+	init_memphy(&mswp[0], 0x1000000, 1);
+	init_memphy_lock();
+#endif
+#ifdef CPU_TLB
+	static struct memphy_struct tlb;
+	init_tlbmemphy(&tlb, 0x10000);
+#endif
+	struct pcb_t * proc = load(argv[1]);
+	proc->last_cpu = 0;
+#ifdef MM_PAGING
+	proc->mm = malloc(sizeof(struct mm_struct));
+	init_mm(proc->mm, proc);
+	proc->mram = &mram;
+	proc->mswp = (struct memphy_struct **)&mswp;
+	proc->active_mswp = &mswp[0];
+#endif
+#ifdef CPU_TLB
+	proc->tlb = &tlb;
+#endif
+	run(proc);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++) {
+		if (proc->pc == proc->code->size)
+			proc->pc = 1;
+		run(proc);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double s = (end.tv_sec - start.tv_sec)
+		+ (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%s: %ld instructions in %.3f s, %.0f per second\n",
+		mem_backend_name(), n, s, n / s);
+	return 0;
+}
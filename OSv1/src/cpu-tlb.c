@@ -13,9 +13,15 @@
  */
  
 #include "mm.h"
+#include "mem-ops.h"
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 
+/* Outcome of the TLB lookups of tlbread, tlbwrite and the block operations */
+static atomic_ulong nr_tlb_hits;
+static atomic_ulong nr_tlb_misses;
+
 int tlb_change_all_page_tables_of(struct pcb_t *proc,  struct memphy_struct * mp)
 {
   /* TODO update all page table directory info 
@@ -153,6 +159,7 @@ int tlbread(struct pcb_t * proc, uint32_t source, uint32_t offset, uint32_t dest
     frmnum = PAGING_FPN(pte); // Get frame number of page table directory
   }
 
+  atomic_fetch_add(frmnum >= 0 ? &nr_tlb_hits : &nr_tlb_misses, 1);
 #ifdef IODUMP
   /* Print TLB hit or miss */
   if (frmnum >= 0) {
@@ -245,6 +252,7 @@ int tlbwrite(struct pcb_t * proc, BYTE data,
     frmnum = PAGING_FPN(pte); // Get frame number of page table directory
   }
 
+  atomic_fetch_add(frmnum >= 0 ? &nr_tlb_hits : &nr_tlb_misses, 1);
 #ifdef IODUMP
   /* Print TLB hit or miss */
   if (frmnum >= 0) {
@@ -295,7 +303,10 @@ int tlbwrite(struct pcb_t * proc, BYTE data,
     addr += offset;
     int off = PAGING_OFFST(addr); // Offset in the page
     int phyaddr = (frmnum << PAGING_ADDR_FPN_LOBIT) + off; // Physical address
-    val = MEMPHY_write(proc->mram, phyaddr, data, RAM_LCK); // Write data
+    /* A frame in the TLB of [proc] is one of its own, victims are only
+     * taken from the pages of the faulting process, and [proc] runs on
+     * one CPU at a time: the byte needs no lock of the RAM */
+    val = MEMPHY_write(proc->mram, phyaddr, data, NO_LCK); // Write data
     if (val < 0) {
 #ifdef DEBUG
       printf("WARNING: Write error\n");
@@ -312,4 +323,165 @@ int tlbwrite(struct pcb_t * proc, BYTE data,
   return val;
 }
 
+/*
+ * tlb_getpage - get the frame of page [pgn] from the TLB, walking the
+ * page table with pg_getpage on a miss
+ */
+static int tlb_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+{
+  uint32_t pte;
+
+  if (tlb_cache_read(caller->tlb, caller->pid, pgn, &pte) == 0
+      && PAGING_PAGE_PRESENT(pte)) {
+    atomic_fetch_add(&nr_tlb_hits, 1);
+    *fpn = PAGING_FPN(pte);
+    return 0;
+  }
+  atomic_fetch_add(&nr_tlb_misses, 1);
+  return pg_getpage(mm, pgn, fpn, caller);
+}
+
+/*
+ * tlb_hit - 1 if the page at [reg] + [offset] of [proc] is present in
+ * the TLB of the CPU running it, so that an access needs no page walk
+ */
+int tlb_hit(struct pcb_t *proc, uint32_t reg, uint32_t offset)
+{
+  uint32_t pte;
+
+  return tlb_cache_read(proc->tlb, proc->pid,
+      PAGING_PGN((proc->regs[reg] + offset)), &pte) == 0
+    && PAGING_PAGE_PRESENT(pte);
+}
+
+/*
+ * tlb_rgid - region which starts at the address held by register [reg],
+ * -1 if none
+ */
+static int tlb_rgid(struct pcb_t *proc, uint32_t reg)
+{
+  int rgid;
+
+  for (rgid = 0; rgid < PAGING_MAX_SYMTBL_SZ; rgid++) {
+    if (proc->mm->symrgtbl[rgid] != NULL
+        && proc->mm->symrgtbl[rgid]->rg_start == proc->regs[reg])
+      return rgid;
+  }
+#ifdef DEBUG
+  printf("WARNING: No region found\n");
+#endif
+  return -1;
+}
+
+/**
+ * tlbreadb - CPU TLB-based read a block of region memory
+ * @proc: Process executing the instruction
+ * @source: Index of source register
+ * @offset: Offset of memory address
+ * @destination: Index of destination register
+ * @size: Number of bytes
+ *
+ * Reads [size] bytes using the TLB once per page. The destination
+ * register ends up as [size] tlbread of the block would leave it.
+ *
+ * Returns 0 on success, 1 on failure as run does.
+ */
+int tlbreadb(struct pcb_t *proc, uint32_t source, uint32_t offset,
+             uint32_t destination, uint32_t size)
+{
+  BYTE data;
+  int rgid = tlb_rgid(proc, source);
+  long addr = rgid < 0 ? -1 : __rg_addr(proc, rgid, offset, size);
+
+  if (addr < 0 || __readb(proc, addr, size, &data, tlb_getpage) < 0)
+    return 1;
+  if (size > 0)
+    proc->regs[destination] = (uint32_t) data;
+#ifdef IODUMP
+  printf("readb source=%d offset=%d size=%d\n", source, offset, size);
+#endif
+  return 0;
+}
+
+/**
+ * tlbmemset - CPU TLB-based write a value to a block of region memory
+ * @proc: Process executing the instruction
+ * @data: Data to write to memory
+ * @destination: Destination register where memory address is stored
+ * @offset: Offset from the memory address in the destination register
+ * @size: Number of bytes
+ *
+ * Returns 0 on success, 1 on failure as run does.
+ */
+int tlbmemset(struct pcb_t *proc, BYTE data, uint32_t destination,
+              uint32_t offset, uint32_t size)
+{
+  int rgid = tlb_rgid(proc, destination);
+  long addr = rgid < 0 ? -1 : __rg_addr(proc, rgid, offset, size);
+
+  if (addr < 0)
+    return 1;
+#ifdef IODUMP
+  printf("memset destination=%d offset=%d size=%d value=%d\n",
+         destination, offset, size, data);
+#endif
+  return pg_setblk(proc->mm, addr, data, size, proc, tlb_getpage) < 0 ? 1 : 0;
+}
+
+/**
+ * tlbmemcpy - CPU TLB-based copy the start of a region memory to another
+ * @proc: Process executing the instruction
+ * @source: Source register where memory address is stored
+ * @destination: Destination register where memory address is stored
+ * @size: Number of bytes
+ *
+ * Returns 0 on success, 1 on failure as run does.
+ */
+int tlbmemcpy(struct pcb_t *proc, uint32_t source, uint32_t destination,
+              uint32_t size)
+{
+  int srcid = tlb_rgid(proc, source);
+  int dstid = tlb_rgid(proc, destination);
+  long src = srcid < 0 ? -1 : __rg_addr(proc, srcid, 0, size);
+  long dst = dstid < 0 ? -1 : __rg_addr(proc, dstid, 0, size);
+
+  if (src < 0 || dst < 0)
+    return 1;
+#ifdef IODUMP
+  printf("memcpy source=%d destination=%d size=%d\n",
+         source, destination, size);
+#endif
+  return pg_cpblk(proc->mm, dst, src, size, proc, tlb_getpage) < 0 ? 1 : 0;
+}
+
+
+/*
+ * print_tlb_stat - Print the hit rate of the TLB lookups of every
+ * tlbread and tlbwrite and of every page of the block operations, and
+ * the entries changed by shootdowns
+ */
+void print_tlb_stat(void)
+{
+  unsigned long hits = atomic_load(&nr_tlb_hits);
+  unsigned long misses = atomic_load(&nr_tlb_misses);
+
+  printf("TLB: %lu hits, %lu misses (hit rate %.1f%%), %lu shootdowns\n",
+         hits, misses,
+         hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+         tlb_nr_shootdowns());
+}
+
+#ifdef CPU_TLB
+struct mem_ops tlb_mem_ops = {
+  .name = "tlb",
+  .alloc = tlballoc,
+  .free = tlbfree_data,
+  .read = tlbread,
+  .write = tlbwrite,
+  .readb = tlbreadb,
+  .fill = tlbmemset,
+  .copy = tlbmemcpy,
+};
+#endif
+
 //#endif
@@ -21,9 +21,22 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #define init_tlbcache(mp,sz,...) init_memphy(mp, sz, (1, ##__VA_ARGS__))
 
-pthread_mutex_t tlb_lock;
+/* Every TLB has a lock of its own, so that the CPUs do not wait on one
+ * another's lookups. The type lives here, as os-mm.h cannot use pthread
+ * types */
+struct tlb_lock {
+   pthread_mutex_t mutex;
+};
+
+/* Every TLB in use, each CPU has its own. A shootdown walks them under
+ * tlb_list_lock, taking the lock of one TLB at a time */
+static pthread_mutex_t tlb_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct memphy_struct ** tlb_list = NULL;
+static int nr_tlbs = 0;
+static atomic_ulong nr_shootdowns;	// TLB entries changed by shootdowns
 
 /**
  * Read from the TLB cache device.
@@ -50,18 +63,18 @@ int tlb_cache_read(struct memphy_struct * mp, int pid, int pgnum, uint32_t *valu
    uint32_t tag = i / (mp->maxsz / 8);
    
    /* Lock the TLB cache. */
-   pthread_mutex_lock(&tlb_lock);
+   pthread_mutex_lock(&mp->lock->mutex);
    
    /* Check if the tag matches. */
    if (storage[id] != tag) {
       /* Unlock and return -1. */
-      pthread_mutex_unlock(&tlb_lock);
+      pthread_mutex_unlock(&mp->lock->mutex);
       return -1;
    }
    
    /* Store the value and unlock. */
    *value = storage[id + 1];
-   pthread_mutex_unlock(&tlb_lock);
+   pthread_mutex_unlock(&mp->lock->mutex);
    
    /* Return 0. */
    return 0;
@@ -85,19 +98,58 @@ int tlb_cache_write(struct memphy_struct *mp, int pid, int pgnum, uint32_t value
    uint32_t tag = i / (mp->maxsz / 8);
 
    /* Lock the TLB cache */
-   pthread_mutex_lock(&tlb_lock);
+   pthread_mutex_lock(&mp->lock->mutex);
 
    /* Store the tag and value */
    storage[id] = tag;
    storage[id + 1] = value;
 
    /* Unlock the TLB cache */
-   pthread_mutex_unlock(&tlb_lock);
+   pthread_mutex_unlock(&mp->lock->mutex);
 
    /* Return success */
    return 0;
 }
 
+/**
+ * Update the entry of the page [pgnum] of process [pid] in every TLB
+ * that caches it, so that no CPU goes on using a stale translation.
+ *
+ * @param pid The process id
+ * @param pgnum The page number
+ * @param value The new page table entry
+ *
+ * @return The number of TLBs in which the entry changed
+ */
+int tlb_shootdown(int pid, int pgnum, uint32_t value)
+{
+   uint32_t i = TLB_INDEX(pid, pgnum);
+   int n = 0;
+   int t;
+
+   pthread_mutex_lock(&tlb_list_lock);
+   for (t = 0; t < nr_tlbs; t++) {
+      struct memphy_struct *mp = tlb_list[t];
+      uint32_t* storage = (uint32_t*) mp->storage;
+      uint32_t id = (i % (mp->maxsz / 8)) * 2;
+      pthread_mutex_lock(&mp->lock->mutex);
+      if (storage[id] == i / (mp->maxsz / 8)
+            && storage[id + 1] != value) {
+         storage[id + 1] = value;
+         n++;
+      }
+      pthread_mutex_unlock(&mp->lock->mutex);
+   }
+   pthread_mutex_unlock(&tlb_list_lock);
+   atomic_fetch_add(&nr_shootdowns, n);
+   return n;
+}
+
+unsigned long tlb_nr_shootdowns(void)
+{
+   return atomic_load(&nr_shootdowns);
+}
+
 /*
  *  TLBMEMPHY_read natively supports MEMPHY device interfaces
  *  @mp: memphy struct
@@ -150,9 +202,15 @@ int TLBMEMPHY_dump(struct memphy_struct * mp, int pid, int pgnum)
    /* Calculate index. */
    uint32_t i = TLB_INDEX(pid, pgnum);
    uint32_t id = (i % (mp->maxsz / 8)) * 2;
+   uint32_t tag, value;
+   /* A shootdown may change the entry meanwhile */
+   pthread_mutex_lock(&mp->lock->mutex);
+   tag = storage[id];
+   value = storage[id + 1];
+   pthread_mutex_unlock(&mp->lock->mutex);
    /* Print the TLB cache entry. */
    printf("TLBMEMPHY dump:\n");
-   printf("%08x: %08x\n", storage[id], storage[id + 1]);
+   printf("%08x: %08x\n", tag, value);
    
    /* Return 0. */
    return 0;
@@ -164,19 +222,37 @@ int TLBMEMPHY_dump(struct memphy_struct * mp, int pid, int pgnum)
  */
 int init_tlbmemphy(struct memphy_struct *mp, int max_size)
 {
-   mp->storage = (BYTE *)malloc(max_size*sizeof(BYTE));
+   mp->storage = (BYTE *)calloc(max_size, sizeof(BYTE));
    mp->maxsz = max_size;
 
    mp->rdmflg = 1;
-   pthread_mutex_init(&tlb_lock, NULL);
+   mp->lock = (struct tlb_lock *)malloc(sizeof(struct tlb_lock));
+   pthread_mutex_init(&mp->lock->mutex, NULL);
+   pthread_mutex_lock(&tlb_list_lock);
+   tlb_list = (struct memphy_struct **)realloc(tlb_list,
+      sizeof(struct memphy_struct *) * (nr_tlbs + 1));
+   tlb_list[nr_tlbs++] = mp;
+   pthread_mutex_unlock(&tlb_list_lock);
    return 0;
 }
 
 int destroy_tlbmemphy(struct memphy_struct *mp) {
    if (mp == NULL)
       return -1;
+   int t;
+   pthread_mutex_lock(&tlb_list_lock);
+   for (t = 0; t < nr_tlbs && tlb_list[t] != mp; t++);
+   if (t < nr_tlbs)
+      tlb_list[t] = tlb_list[--nr_tlbs];
+   if (nr_tlbs == 0) {
+      free(tlb_list);
+      tlb_list = NULL;
+   }
+   pthread_mutex_unlock(&tlb_list_lock);
+   pthread_mutex_destroy(&mp->lock->mutex);
+   free(mp->lock);
+   mp->lock = NULL;
    free(mp->storage);
-   pthread_mutex_destroy(&tlb_lock);
    return 0;
 }
 //#endif
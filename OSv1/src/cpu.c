@@ -1,7 +1,14 @@
 
 #include "cpu.h"
 #include "mem.h"
+#include "mem-ops.h"
 #include "mm.h"
+#include "sched.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 int calc(struct pcb_t * proc) {
 	return ((unsigned long)proc & 0UL);
@@ -28,7 +35,7 @@ int read(
 		uint32_t destination) { // Index of destination register
 	
 	BYTE data;
-	if (read_mem(proc->regs[source] + offset, proc,	&data)) {
+	if (read_mem(proc->regs[source] + offset, proc,	&data) == 0) {
 		proc->regs[destination] = data;
 		return 0;		
 	}else{
@@ -45,60 +52,329 @@ int write(
 	return write_mem(proc->regs[destination] + offset, proc, data);
 } 
 
-int run(struct pcb_t * proc) {
-	/* Check if Program Counter point to the proper instruction */
-	if (proc->pc >= proc->code->size) {
-		return 1;
+/* The block instructions of the legacy memory, byte by byte */
+int read_blk(struct pcb_t * proc, uint32_t source, uint32_t offset,
+		uint32_t destination, uint32_t size) {
+	addr_t addr = proc->regs[source] + offset;
+	BYTE data;
+	uint32_t i;
+	for (i = 0; i < size; i++) {
+		if (read_mem(addr + i, proc, &data)) {
+			return 1;
+		}
+		proc->regs[destination] = data;
 	}
-	
-	struct inst_t ins = proc->code->text[proc->pc];
-	proc->pc++;
-	int stat = 1;
-	switch (ins.opcode) {
-	case CALC:
-		stat = calc(proc);
-		break;
-	case ALLOC:
-#ifdef CPU_TLB 
-		stat = tlballoc(proc, ins.arg_0, ins.arg_1);
-#elif defined(MM_PAGING)
-		stat = pgalloc(proc, ins.arg_0, ins.arg_1);
-#else
-		stat = alloc(proc, ins.arg_0, ins.arg_1);
-#endif
-		break;
-	case FREE:
+	return 0;
+}
+
+int set_blk(struct pcb_t * proc, BYTE data, uint32_t destination,
+		uint32_t offset, uint32_t size) {
+	addr_t addr = proc->regs[destination] + offset;
+	uint32_t i;
+	for (i = 0; i < size; i++) {
+		if (write_mem(addr + i, proc, data)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int copy_blk(struct pcb_t * proc, uint32_t source, uint32_t destination,
+		uint32_t size) {
+	BYTE data;
+	uint32_t i;
+	for (i = 0; i < size; i++) {
+		if (read_mem(proc->regs[source] + i, proc, &data)
+				|| write_mem(proc->regs[destination] + i, proc, data)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+struct mem_ops legacy_mem_ops = {
+	.name = "legacy",
+	.init = init_mem,
+	.alloc = alloc,
+	.free = free_data,
+	.read = read,
+	.write = write,
+	.readb = read_blk,
+	.fill = set_blk,
+	.copy = copy_blk,
+};
+
+/* The memory backends, the first one is the default */
+static struct mem_ops * mem_backends[] = {
 #ifdef CPU_TLB
-		stat = tlbfree_data(proc, ins.arg_0);
-#elif defined(MM_PAGING)
-		stat = pgfree_data(proc, ins.arg_0);
-#else
-		stat = free_data(proc, ins.arg_0);
+	&tlb_mem_ops,
 #endif
-		break;
-	case READ:
-#ifdef CPU_TLB
-		stat = tlbread(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#elif defined(MM_PAGING)
-		stat = pgread(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+#ifdef MM_PAGING
+	&paging_mem_ops,
 #endif
-		break;
-	case WRITE:
-#ifdef CPU_TLB
-		stat = tlbwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#elif defined(MM_PAGING)
-		stat = pgwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#endif
-		break;
-	default:
-		stat = 1;
+	&legacy_mem_ops,
+};
+
+#define NR_MEM_BACKENDS	(sizeof(mem_backends) / sizeof(mem_backends[0]))
+
+static struct mem_ops * mem = NULL;
+
+int set_mem_backend(const char * name) {
+	int i;
+	for (i = 0; i < NR_MEM_BACKENDS; i++) {
+		if (!strcmp(mem_backends[i]->name, name)) {
+			mem = mem_backends[i];
+			return 0;
+		}
 	}
+	return -1;
+}
+
+const char * mem_backend_name(void) {
+	return mem != NULL ? mem->name : mem_backends[0]->name;
+}
+
+void init_mem_backend(void) {
+	if (mem == NULL)
+		mem = mem_backends[0];
+	if (mem->init != NULL)
+		mem->init();
+}
+
+/* Host time of the memory instructions, accounted with mem_account */
+enum mem_op {
+	MEM_ALLOC, MEM_FREE, MEM_READ, MEM_WRITE,
+	MEM_READB, MEM_MEMSET, MEM_MEMCPY, NR_MEM_OPS
+};
+
+static const char * mem_op_names[NR_MEM_OPS] = {
+	"ALLOC", "FREE", "READ", "WRITE", "READB", "MEMSET", "MEMCPY"
+};
+static int mem_timed = 0;
+static atomic_ulong mem_nr[NR_MEM_OPS];
+static atomic_ulong mem_ns[NR_MEM_OPS];
+static atomic_ulong mem_bytes[NR_MEM_OPS];	// Bytes moved, 0 for ALLOC and FREE
+
+void mem_account(int enable) {
+	mem_timed = enable;
+}
+
+static void mem_charge(enum mem_op op, uint32_t bytes,
+		struct timespec * from) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	atomic_fetch_add(&mem_nr[op], 1);
+	atomic_fetch_add(&mem_bytes[op], bytes);
+	atomic_fetch_add(&mem_ns[op], (now.tv_sec - from->tv_sec) * 1000000000UL
+		+ now.tv_nsec - from->tv_nsec);
+}
+
+void print_mem_stat(void) {
+	unsigned long nr, ns, bytes = 0, bytes_ns = 0;
+	int i;
+	printf("Memory backend: %s\n", mem_backend_name());
+	for (i = 0; i < NR_MEM_OPS; i++) {
+		nr = atomic_load(&mem_nr[i]);
+		ns = atomic_load(&mem_ns[i]);
+		printf("%s: %lu, %.0f ns each\n", mem_op_names[i], nr,
+			nr > 0 ? (double)ns / nr : 0.0);
+		if (i != MEM_ALLOC && i != MEM_FREE) {
+			bytes += atomic_load(&mem_bytes[i]);
+			bytes_ns += ns;
+		}
+	}
+	printf("Memory accesses: %lu bytes, %.1f ns per byte\n", bytes,
+		bytes > 0 ? (double)bytes_ns / bytes : 0.0);
+}
+
+/* Handlers of the decoded instructions */
+static int exec_calc(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return calc(proc);
+}
+
+static int exec_alloc(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return ins->mem.alloc(proc, ins->arg_0, ins->arg_1);
+}
+
+static int exec_free(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return ins->mem.free(proc, ins->arg_0);
+}
+
+static int exec_read(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return ins->mem.read(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int exec_write(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return ins->mem.write(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int exec_readb(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return ins->mem.readb(proc, ins->arg_0, ins->arg_1, ins->arg_2,
+		ins->arg_3);
+}
+
+static int exec_memset(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return ins->mem.fill(proc, ins->arg_0, ins->arg_1, ins->arg_2,
+		ins->arg_3);
+}
+
+static int exec_memcpy(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return ins->mem.copy(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+/* Handlers of the memory instructions, in the order of enum mem_op */
+static const exec_t mem_exec[NR_MEM_OPS] = {
+	exec_alloc, exec_free, exec_read, exec_write,
+	exec_readb, exec_memset, exec_memcpy
+};
+
+/* Memory operation of [opcode], NR_MEM_OPS if it is none */
+static enum mem_op mem_op_of(enum ins_opcode_t opcode) {
+	switch (opcode) {
+	case ALLOC:	return MEM_ALLOC;
+	case FREE:	return MEM_FREE;
+	case READ:	return MEM_READ;
+	case WRITE:	return MEM_WRITE;
+	case READB:	return MEM_READB;
+	case MEMSET:	return MEM_MEMSET;
+	case MEMCPY:	return MEM_MEMCPY;
+	default:	return NR_MEM_OPS;
+	}
+}
+
+/* Handler of the memory instructions decoded with mem_account on: it runs
+ * the one of [ins], accounting the host time it takes and the bytes it
+ * moves. The instruction [ins] was decoded from tells which it is */
+static int exec_timed(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	enum mem_op op = mem_op_of(proc->code->text[ins - proc->code->ops].opcode);
+	uint32_t bytes = 0;
+	struct timespec start;
+	int stat;
+	if (op == MEM_READ || op == MEM_WRITE) {
+		bytes = 1;
+	}else if (op == MEM_READB || op == MEM_MEMSET) {
+		bytes = ins->arg_3;
+	}else if (op == MEM_MEMCPY) {
+		bytes = ins->arg_2;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	stat = mem_exec[op](proc, ins);
+	mem_charge(op, bytes, &start);
 	return stat;
+}
+
+/* arg_2 holds the type of the object */
+static int exec_wait(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	int stat = sync_wait(proc->last_cpu, proc, ins->arg_2, ins->arg_0);
+	return stat < 0 ? 1 : (stat > 0 ? RUN_BLOCKED : 0);
+}
+
+static int exec_post(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	int stat = sync_post(proc->last_cpu, proc, ins->arg_2, ins->arg_0);
+	return stat < 0 ? 1 : (stat > 0 ? RUN_WOKE : 0);
+}
 
+static int exec_io(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	int stat = io_submit(proc->last_cpu, proc, ins->arg_0, ins->arg_1);
+	return stat < 0 ? 1 : RUN_BLOCKED;
 }
 
+static int exec_sleep(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return sched_sleep(proc->last_cpu, proc, ins->arg_0) > 0
+		? RUN_BLOCKED : 0;
+}
+
+static int exec_invalid(struct pcb_t * proc, const struct dec_inst_t * ins) {
+	return 1;
+}
+
+void decode(struct code_seg_t * code) {
+	uint32_t i;
+	code->ops = (struct dec_inst_t *)malloc(
+		sizeof(struct dec_inst_t) * code->size);
+	for (i = 0; i < code->size; i++) {
+		struct inst_t * ins = &code->text[i];
+		struct dec_inst_t * op = &code->ops[i];
+		enum mem_op mop = mem_op_of(ins->opcode);
+		op->arg_0 = ins->arg_0;
+		op->arg_1 = ins->arg_1;
+		op->arg_2 = ins->arg_2;
+		op->arg_3 = ins->arg_3;
+		if (mop != NR_MEM_OPS) {
+			op->exec = mem_timed ? exec_timed : mem_exec[mop];
+		}
+		switch (ins->opcode) {
+		case CALC:
+			op->exec = exec_calc;
+			break;
+		case ALLOC:
+			op->mem.alloc = mem->alloc;
+			break;
+		case FREE:
+			op->mem.free = mem->free;
+			break;
+		case READ:
+			op->mem.read = mem->read;
+			break;
+		case WRITE:
+			op->mem.write = mem->write;
+			break;
+		case READB:
+			op->mem.readb = mem->readb;
+			break;
+		case MEMSET:
+			op->mem.fill = mem->fill;
+			break;
+		case MEMCPY:
+			op->mem.copy = mem->copy;
+			break;
+		case LOCK:
+		case SEM_WAIT:
+			op->exec = exec_wait;
+			op->arg_2 = ins->opcode == LOCK ? SYNC_LOCK : SYNC_SEM;
+			break;
+		case UNLOCK:
+		case SEM_POST:
+			op->exec = exec_post;
+			op->arg_2 = ins->opcode == UNLOCK ? SYNC_LOCK : SYNC_SEM;
+			break;
+		case IO:
+			op->exec = exec_io;
+			break;
+		case SLEEP:
+			op->exec = exec_sleep;
+			break;
+		default:
+			op->exec = exec_invalid;
+		}
+	}
+}
 
+int run_local(struct pcb_t * proc) {
+	const struct inst_t * ins = &proc->code->text[proc->pc];
+	switch (ins->opcode) {
+	case CALC:
+		return 1;
+#if defined(CPU_TLB) && !defined(IODUMP) && !defined(TLBDUMP) \
+		&& !defined(DEBUG)
+	/* The dumps of a batched access would come out in the slot of the
+	 * batch instead of its own, so with dumps they are not batched */
+	case READ:
+		return mem == &tlb_mem_ops && tlb_hit(proc, ins->arg_0, ins->arg_1);
+	case WRITE:
+		return mem == &tlb_mem_ops && tlb_hit(proc, ins->arg_1, ins->arg_2);
+#endif
+	default:
+		return 0;
+	}
+}
+
+int run(struct pcb_t * proc) {
+	/* Check if Program Counter point to the proper instruction */
+	if (proc->pc >= proc->code->size) {
+		return 1;
+	}
+	const struct dec_inst_t * ins = &proc->code->ops[proc->pc];
+	proc->pc++;
+	return ins->exec(proc, ins);
+}
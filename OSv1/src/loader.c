@@ -1,5 +1,6 @@
 
 #include "loader.h"
+#include "cpu.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,15 @@ static uint32_t avail_pid = 1;
 #define OPT_FREE	"free"
 #define OPT_READ	"read"
 #define OPT_WRITE	"write"
+#define OPT_LOCK	"lock"
+#define OPT_UNLOCK	"unlock"
+#define OPT_SEM_WAIT	"sem_wait"
+#define OPT_SEM_POST	"sem_post"
+#define OPT_IO		"io"
+#define OPT_SLEEP	"sleep"
+#define OPT_READB	"readb"
+#define OPT_MEMSET	"memset"
+#define OPT_MEMCPY	"memcpy"
 
 static enum ins_opcode_t get_opcode(char * opt) {
 	if (!strcmp(opt, OPT_CALC)) {
@@ -23,6 +33,24 @@ static enum ins_opcode_t get_opcode(char * opt) {
 		return READ;
 	}else if (!strcmp(opt, OPT_WRITE)) {
 		return WRITE;
+	}else if (!strcmp(opt, OPT_LOCK)) {
+		return LOCK;
+	}else if (!strcmp(opt, OPT_UNLOCK)) {
+		return UNLOCK;
+	}else if (!strcmp(opt, OPT_SEM_WAIT)) {
+		return SEM_WAIT;
+	}else if (!strcmp(opt, OPT_SEM_POST)) {
+		return SEM_POST;
+	}else if (!strcmp(opt, OPT_IO)) {
+		return IO;
+	}else if (!strcmp(opt, OPT_SLEEP)) {
+		return SLEEP;
+	}else if (!strcmp(opt, OPT_READB)) {
+		return READB;
+	}else if (!strcmp(opt, OPT_MEMSET)) {
+		return MEMSET;
+	}else if (!strcmp(opt, OPT_MEMCPY)) {
+		return MEMCPY;
 	}else{
 		printf("Opcode: %s\n", opt);
 		exit(1);
@@ -35,7 +63,7 @@ struct pcb_t * load(const char * path) {
 	proc->pid = avail_pid;
 	avail_pid++;
 	proc->page_table =
-		(struct page_table_t*)malloc(sizeof(struct page_table_t));
+		(struct page_table_t*)calloc(1, sizeof(struct page_table_t));
 	proc->bp = PAGE_SIZE;
 	proc->pc = 0;
 
@@ -59,6 +87,7 @@ struct pcb_t * load(const char * path) {
 		case CALC:
 			break;
 		case ALLOC:
+		case IO:
 			fscanf(
 				file,
 				"%u %u\n",
@@ -67,10 +96,16 @@ struct pcb_t * load(const char * path) {
 			);
 			break;
 		case FREE:
+		case LOCK:
+		case UNLOCK:
+		case SEM_WAIT:
+		case SEM_POST:
+		case SLEEP:
 			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
 			break;
 		case READ:
 		case WRITE:
+		case MEMCPY:
 			fscanf(
 				file,
 				"%u %u %u\n",
@@ -79,11 +114,24 @@ struct pcb_t * load(const char * path) {
 				&proc->code->text[i].arg_2
 			);
 			break;	
+		case READB:
+		case MEMSET:
+			fscanf(
+				file,
+				"%u %u %u %u\n",
+				&proc->code->text[i].arg_0,
+				&proc->code->text[i].arg_1,
+				&proc->code->text[i].arg_2,
+				&proc->code->text[i].arg_3
+			);
+			break;
 		default:
 			printf("Opcode: %s\n", opcode);
 			exit(1);
 		}
 	}
+	fclose(file);
+	decode(proc->code);
 	return proc;
 }
 
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <string.h>
 
 pthread_mutex_t ram_lock;
 pthread_mutex_t swp_lock;
@@ -123,18 +124,122 @@ int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data, BYTE option)
    case SWP_LCK:
       lock = &swp_lock;
       break;   
+   case NO_LCK:
+      lock = NULL;
+      break;
    default:
       return -1;
    }
-   pthread_mutex_lock(lock);
+   if (lock != NULL)
+      pthread_mutex_lock(lock);
    if (mp->rdmflg)
       mp->storage[addr] = data;
    else {
       /* Sequential access device */
       int val = MEMPHY_seq_write(mp, addr, data);
-      pthread_mutex_unlock(lock);
+      if (lock != NULL)
+         pthread_mutex_unlock(lock);
       return val;
    }
+   if (lock != NULL)
+      pthread_mutex_unlock(lock);
+   return 0;
+}
+
+/*
+ *  memphy_lock - lock of a MEMPHY device
+ *  @option: RAM_LCK or SWP_LCK
+ */
+static pthread_mutex_t *memphy_lock(BYTE option)
+{
+   switch (option)
+   {
+   case RAM_LCK:
+      return &ram_lock;
+   case SWP_LCK:
+      return &swp_lock;
+   default:
+      return NULL;
+   }
+}
+
+/*
+ *  MEMPHY_read_blk - read a run of bytes of MEMPHY device, holding the
+ *  lock once for the whole run
+ *  @mp: memphy struct
+ *  @addr: address of the first byte
+ *  @buf: obtained bytes
+ *  @size: number of bytes
+ *  @option: RAM_LCK or SWP_LCK
+ */
+int MEMPHY_read_blk(struct memphy_struct *mp, int addr, BYTE *buf, int size, BYTE option)
+{
+   pthread_mutex_t *lock = memphy_lock(option);
+   int i;
+
+   if (mp == NULL || lock == NULL || addr < 0 || addr + size > mp->maxsz)
+     return -1;
+
+   pthread_mutex_lock(lock);
+   if (mp->rdmflg)
+      memcpy(buf, mp->storage + addr, size);
+   else /* Sequential access device */
+      for (i = 0; i < size; i++)
+         MEMPHY_seq_read(mp, addr + i, &buf[i]);
+   pthread_mutex_unlock(lock);
+   return 0;
+}
+
+/*
+ *  MEMPHY_write_blk - write a run of bytes of MEMPHY device, holding the
+ *  lock once for the whole run
+ *  @mp: memphy struct
+ *  @addr: address of the first byte
+ *  @buf: written bytes
+ *  @size: number of bytes
+ *  @option: RAM_LCK or SWP_LCK
+ */
+int MEMPHY_write_blk(struct memphy_struct *mp, int addr, const BYTE *buf, int size, BYTE option)
+{
+   pthread_mutex_t *lock = memphy_lock(option);
+   int i;
+
+   if (mp == NULL || lock == NULL || addr < 0 || addr + size > mp->maxsz)
+     return -1;
+
+   pthread_mutex_lock(lock);
+   if (mp->rdmflg)
+      memcpy(mp->storage + addr, buf, size);
+   else /* Sequential access device */
+      for (i = 0; i < size; i++)
+         MEMPHY_seq_write(mp, addr + i, buf[i]);
+   pthread_mutex_unlock(lock);
+   return 0;
+}
+
+/*
+ *  MEMPHY_set_blk - write the same byte to a run of MEMPHY device,
+ *  holding the lock once for the whole run
+ *  @mp: memphy struct
+ *  @addr: address of the first byte
+ *  @data: written data
+ *  @size: number of bytes
+ *  @option: RAM_LCK or SWP_LCK
+ */
+int MEMPHY_set_blk(struct memphy_struct *mp, int addr, BYTE data, int size, BYTE option)
+{
+   pthread_mutex_t *lock = memphy_lock(option);
+   int i;
+
+   if (mp == NULL || lock == NULL || addr < 0 || addr + size > mp->maxsz)
+     return -1;
+
+   pthread_mutex_lock(lock);
+   if (mp->rdmflg)
+      memset(mp->storage + addr, data, size);
+   else /* Sequential access device */
+      for (i = 0; i < size; i++)
+         MEMPHY_seq_write(mp, addr + i, data);
    pthread_mutex_unlock(lock);
    return 0;
 }
@@ -476,7 +581,7 @@ int MEMPHY_pop_usedfp(struct memphy_struct *mp, int *fpn, int *pgn, struct mm_st
  */
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
 {
-   mp->storage = (BYTE *)malloc(max_size*sizeof(BYTE));
+   mp->storage = (BYTE *)calloc(max_size, sizeof(BYTE));
    mp->maxsz = max_size;
 
    MEMPHY_format(mp,PAGING_PAGESZ);
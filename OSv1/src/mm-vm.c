@@ -6,6 +6,7 @@
 
 #include "string.h"
 #include "mm.h"
+#include "mem-ops.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -164,8 +165,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
       
       // Clear the page table entry
       caller->mm->pgd[i] = 0;   
-      if (tlb_cache_read(caller->tlb, caller->pid, i, &pte) == 0)
-        tlb_cache_write(caller->tlb, caller->pid, i, 0);
+      tlb_shootdown(caller->pid, i, 0);
   }
 
   return 0;
@@ -233,10 +233,9 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
     pte_set_fpn(&mm->pgd[pgn], vicfpn);
 
 #ifdef CPU_TLB
-    /* Update its online status of TLB */
-    uint32_t tmppte;
-    if (tlb_cache_read(vicmm->owner->tlb, vicmm->owner->pid, vicpgn, &tmppte) == 0)
-      tlb_cache_write(vicmm->owner->tlb, vicmm->owner->pid, vicpgn, vicmm->pgd[vicpgn]);
+    /* Update its online status in every TLB, the victim may have
+     * run on any CPU */
+    tlb_shootdown(vicmm->owner->pid, vicpgn, vicmm->pgd[vicpgn]);
 #endif
     MEMPHY_put_usedfp(caller->mram, vicfpn, mm, pgn, RAM_LCK);
   } else {
@@ -293,6 +292,189 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
   return 0;
 }
 
+/*pg_getrun - get the page of a run of bytes in ram, translating it once
+ *@mm: memory region
+ *@addr: virtual address of the first byte
+ *@size: bytes left to access
+ *@phyaddr: return physical address of [addr]
+ *@caller: caller
+ *@getpage: pg_getpage, or a TLB lookup in front of it
+ *
+ *Return the bytes of the run that lie in the page of [addr], -1 if the
+ *page is invalid
+ */
+static int pg_getrun(struct mm_struct *mm, int addr, int size, int *phyaddr,
+                     struct pcb_t *caller, getpage_t getpage)
+{
+  int off = PAGING_OFFST(addr);
+  int fpn;
+
+  if (getpage(mm, PAGING_PGN(addr), &fpn, caller) != 0)
+    return -1; /* invalid page access */
+
+  *phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
+  return size < PAGING_PAGESZ - off ? size : PAGING_PAGESZ - off;
+}
+
+/*pg_getblk - read a block at given address, page by page
+ *@mm: memory region
+ *@addr: virtual address of the first byte
+ *@buf: obtained bytes
+ *@size: number of bytes
+ *@caller: caller
+ *@getpage: pg_getpage, or a TLB lookup in front of it
+ *
+ */
+int pg_getblk(struct mm_struct *mm, int addr, BYTE *buf, int size,
+              struct pcb_t *caller, getpage_t getpage)
+{
+  int phyaddr, run;
+
+  while (size > 0)
+  {
+    run = pg_getrun(mm, addr, size, &phyaddr, caller, getpage);
+    if (run < 0
+        || MEMPHY_read_blk(caller->mram, phyaddr, buf, run, RAM_LCK) < 0)
+      return -1;
+    addr += run;
+    buf += run;
+    size -= run;
+  }
+  return 0;
+}
+
+/*pg_putblk - write a block at given address, page by page
+ *@mm: memory region
+ *@addr: virtual address of the first byte
+ *@buf: written bytes
+ *@size: number of bytes
+ *@caller: caller
+ *@getpage: pg_getpage, or a TLB lookup in front of it
+ *
+ */
+int pg_putblk(struct mm_struct *mm, int addr, const BYTE *buf, int size,
+              struct pcb_t *caller, getpage_t getpage)
+{
+  int phyaddr, run;
+
+  while (size > 0)
+  {
+    run = pg_getrun(mm, addr, size, &phyaddr, caller, getpage);
+    if (run < 0
+        || MEMPHY_write_blk(caller->mram, phyaddr, buf, run, RAM_LCK) < 0)
+      return -1;
+    addr += run;
+    buf += run;
+    size -= run;
+  }
+  return 0;
+}
+
+/*pg_setblk - write a value to a block at given address, page by page
+ *@mm: memory region
+ *@addr: virtual address of the first byte
+ *@value: value
+ *@size: number of bytes
+ *@caller: caller
+ *@getpage: pg_getpage, or a TLB lookup in front of it
+ *
+ */
+int pg_setblk(struct mm_struct *mm, int addr, BYTE value, int size,
+              struct pcb_t *caller, getpage_t getpage)
+{
+  int phyaddr, run;
+
+  while (size > 0)
+  {
+    run = pg_getrun(mm, addr, size, &phyaddr, caller, getpage);
+    if (run < 0
+        || MEMPHY_set_blk(caller->mram, phyaddr, value, run, RAM_LCK) < 0)
+      return -1;
+    addr += run;
+    size -= run;
+  }
+  return 0;
+}
+
+/*pg_cpblk - copy a block to another, page by page of the source
+ *@mm: memory region
+ *@dst: virtual address of the first byte of the copy
+ *@src: virtual address of the first byte of the source
+ *@size: number of bytes
+ *@caller: caller
+ *@getpage: pg_getpage, or a TLB lookup in front of it
+ *
+ *The bytes go through a page sized buffer: bringing in the page of [dst]
+ *may swap out the one of [src]
+ */
+int pg_cpblk(struct mm_struct *mm, int dst, int src, int size,
+             struct pcb_t *caller, getpage_t getpage)
+{
+  BYTE buf[PAGING_PAGESZ];
+  int run;
+
+  while (size > 0)
+  {
+    run = PAGING_PAGESZ - PAGING_OFFST(src);
+    if (run > size)
+      run = size;
+    if (pg_getblk(mm, src, buf, run, caller, getpage) < 0
+        || pg_putblk(mm, dst, buf, run, caller, getpage) < 0)
+      return -1;
+    src += run;
+    dst += run;
+    size -= run;
+  }
+  return 0;
+}
+
+/*__rg_addr - virtual address of a block in region memory
+ *@caller: caller
+ *@rgid: memory region ID (used to identify variable in symbole table)
+ *@offset: offset of the block in the region
+ *@size: number of bytes
+ *
+ *Return -1 if the block does not lie in the region
+ */
+long __rg_addr(struct pcb_t *caller, int rgid, uint32_t offset, uint32_t size)
+{
+  struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
+
+  if (currg == NULL
+      || (unsigned long)offset + size > currg->rg_end - currg->rg_start)
+    return -1; /* Invalid memory identify */
+
+  return currg->rg_start + offset;
+}
+
+/*__readb - read a block, keeping only its last byte
+ *@caller: caller
+ *@addr: virtual address of the first byte
+ *@size: number of bytes
+ *@data: last byte, left as is if [size] is 0
+ *@getpage: pg_getpage, or a TLB lookup in front of it
+ *
+ */
+int __readb(struct pcb_t *caller, int addr, int size, BYTE *data,
+            getpage_t getpage)
+{
+  BYTE buf[PAGING_PAGESZ];
+  int run;
+
+  while (size > 0)
+  {
+    run = PAGING_PAGESZ - PAGING_OFFST(addr);
+    if (run > size)
+      run = size;
+    if (pg_getblk(caller->mm, addr, buf, run, caller, getpage) < 0)
+      return -1;
+    *data = buf[run - 1];
+    addr += run;
+    size -= run;
+  }
+  return 0;
+}
+
 /*__read - read value in region memory
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -326,7 +508,7 @@ int pgread(
   BYTE data;
   int val = __read(proc, proc->mm->mmap->vm_id, source, offset, &data);
 
-  destination = (uint32_t) data;
+  proc->regs[destination] = (uint32_t) data;
 #ifdef IODUMP
   printf("read region=%d offset=%d value=%d\n", source, offset, data);
 #ifdef PAGETBL_DUMP
@@ -378,6 +560,84 @@ int pgwrite(
   return __write(proc, proc->mm->mmap->vm_id, destination, offset, data);
 }
 
+/*pgreadb - PAGING-based read a block of region memory. The destination
+ *register ends up as [size] reads of the block would leave it. The block
+ *operations return 1 on failure, as run does
+ */
+int pgreadb(
+		struct pcb_t * proc, // Process executing the instruction
+		uint32_t source, // Index of source register
+		uint32_t offset, // Source address = [source] + [offset]
+		uint32_t destination, // Index of destination register
+		uint32_t size) // Number of bytes
+{
+  BYTE data;
+  long addr = __rg_addr(proc, source, offset, size);
+
+  if (addr < 0 || __readb(proc, addr, size, &data, pg_getpage) < 0)
+    return 1;
+  if (size > 0)
+    proc->regs[destination] = (uint32_t) data;
+#ifdef IODUMP
+  printf("readb region=%d offset=%d size=%d\n", source, offset, size);
+#endif
+
+  return 0;
+}
+
+/*pgmemset - PAGING-based write a value to a block of region memory */
+int pgmemset(
+		struct pcb_t * proc, // Process executing the instruction
+		BYTE data, // Data to be wrttien into memory
+		uint32_t destination, // Index of destination register
+		uint32_t offset, // Destination address = [destination] + [offset]
+		uint32_t size) // Number of bytes
+{
+  long addr = __rg_addr(proc, destination, offset, size);
+
+  if (addr < 0)
+    return 1;
+#ifdef IODUMP
+  printf("memset region=%d offset=%d size=%d value=%d\n",
+         destination, offset, size, data);
+#endif
+
+  return pg_setblk(proc->mm, addr, data, size, proc, pg_getpage) < 0 ? 1 : 0;
+}
+
+/*pgmemcpy - PAGING-based copy the start of a region memory to another */
+int pgmemcpy(
+		struct pcb_t * proc, // Process executing the instruction
+		uint32_t source, // Index of source register
+		uint32_t destination, // Index of destination register
+		uint32_t size) // Number of bytes
+{
+  long src = __rg_addr(proc, source, 0, size);
+  long dst = __rg_addr(proc, destination, 0, size);
+
+  if (src < 0 || dst < 0)
+    return 1;
+#ifdef IODUMP
+  printf("memcpy region=%d to region=%d size=%d\n",
+         source, destination, size);
+#endif
+
+  return pg_cpblk(proc->mm, dst, src, size, proc, pg_getpage) < 0 ? 1 : 0;
+}
+
+#ifdef MM_PAGING
+struct mem_ops paging_mem_ops = {
+  .name = "paging",
+  .alloc = pgalloc,
+  .free = pgfree_data,
+  .read = pgread,
+  .write = pgwrite,
+  .readb = pgreadb,
+  .fill = pgmemset,
+  .copy = pgmemcpy,
+};
+#endif
+
 
 /*free_pcb_memphy - collect all memphy of pcb
  *@caller: caller
@@ -197,8 +197,8 @@ for(pgit = 0; pgit < req_pgnum; pgit++)
         __swap_cp_page(caller->mram, fpn, caller->active_mswp, swpfpn, SWP_LCK);
         // Update the page table entry of the victim process to point to the swap frame
         pte_set_swap(&vicmm->pgd[pgn], 0, swpfpn);
-        // Update the TLB cache with the swapped page
-        tlb_cache_write(caller->tlb, caller->pid, pgn, vicmm->pgd[pgn]);        
+        // Update the TLB entries of the swapped page of the victim
+        tlb_shootdown(vicmm->owner->pid, pgn, vicmm->pgd[pgn]);
 
         // Allocate memory for a new frame physical structure
         newfp_str = malloc(sizeof(struct framephy_struct));
@@ -283,7 +283,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 {
   struct vm_area_struct * vma = malloc(sizeof(struct vm_area_struct));
 
-  mm->pgd = malloc(PAGING_MAX_PGN*sizeof(uint32_t));
+  mm->pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
   mm->owner = caller;
   /* By default the owner comes with at least one vma */
   vma->vm_id = 0;
@@ -6,13 +6,23 @@
 #include "mm.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
-static int time_slot;
-static int num_cpus;
-static int done = 0;
+static int time_slot;	// Quantum of the priorities out of every band
+static int num_cpus;	// CPUs online when the run starts
+static int max_cpus;	// Largest number of CPUs online during the run
+static atomic_int done;	// Every process has been loaded
+static int print_stat = 0;
+static int batch_calc = 0;
+static int preempt = 0;
+static char sched_name[100];	// Scheduler policy of the config
+static char mem_name[100];	// Memory backend of the config
+
+#define USAGE "Usage: os [-s] [-d] [-b] [-P] [-S policy] [-m tlb|paging|legacy] [-e thread|serial|pool] [-w workers] [path to configure file]\n"
 
 #ifdef CPU_TLB
 static int tlbsz;
@@ -24,159 +34,894 @@ static int memswpsz[PAGING_MAX_MMSWP];
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
-	struct memphy_struct *tlb;
 	struct memphy_struct *mram;
 	struct memphy_struct **mswp;
 	struct memphy_struct *active_mswp;
-	struct timer_id_t  *timer_id;
 };
 #endif
 
 static struct ld_args{
 	char ** path;
 	unsigned long * start_time;
-#ifdef MLQ_SCHED
 	unsigned long * prio;
-#endif
+	unsigned long * deadline;	// Slots after the start time, 0 if none
 } ld_processes;
 int num_processes;
 
+/* CPU hot-plug events of the config: from slot [time] on, the CPUs with
+ * ID below [num_cpus] are online */
+struct cpu_event {
+	unsigned long time;
+	int num_cpus;
+};
+static struct cpu_event * cpu_events;
+static int num_cpu_events = 0;
+static atomic_int next_cpu_event;
+static pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A stretch of the run with a fixed number of online CPUs. The counters
+ * are the totals of every CPU when the clock enters slot [start], taken
+ * once every CPU has finished the slot before */
+struct cpu_phase {
+	uint64_t start;
+	int num_cpus;
+	int pending;	// The counters are not taken yet
+	unsigned long nr_inst;
+	unsigned long nr_finished;
+	unsigned long turnaround;
+};
+static struct cpu_phase * phases;
+static int num_phases = 0;
+
+/* Priority bands with a quantum of their own, set by the config. Band 0
+ * holds the priorities which are in no other band */
+struct quantum_band {
+	int lo;
+	int hi;
+	int len;
+	/* Totals of the finished processes of the band */
+	unsigned long nr_procs;
+	unsigned long nr_switches;
+	unsigned long nr_inst;
+	unsigned long turnaround;
+};
+static struct quantum_band * bands;
+static int num_bands = 1;
+static int prio_band[MAX_PRIO];	// Band of every priority
+static pthread_mutex_t band_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Timer event of the loader in the threaded and pool engines */
+static struct timer_id_t * ld_event;
+
+/* Engines driving CPUs and loader */
+enum engine_t {
+	ENGINE_THREAD,	// One host thread per CPU and one for the loader
+	ENGINE_SERIAL,	// Everything on the main thread in a fixed order
+	ENGINE_POOL	// CPUs multiplexed on a fixed pool of host threads
+};
+static enum engine_t engine = ENGINE_THREAD;
+
+/* Host worker of the pool engine. A worker owns the CPUs with ID in
+ * [start, end) and steals CPUs of other workers once it runs out */
+struct pool_worker {
+	int id;
+	int start;
+	int end;
+	atomic_int next;	// Next CPU of the range to run in this slot
+	pthread_t thread;
+};
+
+static struct pool_worker * workers;
+static int num_workers = 0;
+static atomic_int pool_alive;	// CPUs that have not stopped yet
+static _Atomic uint64_t pool_wake;
+static atomic_int pool_busy;	// Some CPU runs a process in this slot
+static int pool_exit = 0;
+static pthread_barrier_t pool_barrier;
+static struct timer_id_t * pool_event;
+
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
+	/* State of the CPU kept between time slots */
+	struct pcb_t * proc;
+	int time_left;
+	uint64_t wake;	// First slot in which the CPU has to run again
+	/* Hot-plug state, changed under hotplug_lock. CPUs and pool
+	 * workers read it at every step without the lock */
+	atomic_int online;	// CPU is plugged in
+	atomic_int stopped;	// CPU does not run, it has no thread in the threaded engine
+	/* Parking of an idle CPU, changed under park_lock. The serial and
+	 * pool engines read it without the lock to skip parked CPUs */
+	atomic_int parked;	// CPU is idle and takes part in no slot until woken
+	unsigned long idle_gen;	// work_gen when the CPU last looked for work
+#ifdef CPU_TLB
+	struct memphy_struct tlb;	// TLB of the CPU, given to every process it runs
+#endif
+	/* Preemption of the running process by the loader */
+	atomic_int curr_prio;	// Priority of the running process, -1 if idle
+	atomic_int need_resched;	// A better process has arrived
+	/* Statistics, only ever written by the CPU itself */
+	unsigned long nr_preempted;
+	unsigned long nr_parks;
+	unsigned long nr_inst;
+	unsigned long nr_finished;
+	unsigned long turnaround;	// Sum of slots from load to finish
 };
 
+static struct cpu_args * cpu_list;
 
-static void * cpu_routine(void * args) {
-	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
-	int id = ((struct cpu_args*)args)->id;
-	/* Check for new process in ready queue */
-	int time_left = 0;
-	struct pcb_t * proc = NULL;
-	while (1) {
-		/* Check the status of current process */
-		if (proc == NULL) {
-			/* No process is running, the we load new process from
-		 	* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           //continue; /* First load failed. skip dummy load */
-                        }
-		}else if (proc->pc == proc->code->size) {
-			/* The process has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			free(proc->code->text);
-			free(proc->code);
+/* Idle CPUs park instead of looking for work in every slot. Whatever may
+ * hand them work bumps work_gen, so a CPU never parks on a process that
+ * came in after its last look */
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_ulong work_gen;
+static int nr_parked = 0;
+
+/* Host threads of the threaded engine that run a CPU */
+static int nr_cpu_threads = 0;
+static pthread_cond_t cpu_threads_cond = PTHREAD_COND_INITIALIZER;
+
+/* Index of the next process the loader has to load */
+static int ld_next = 0;
+
+/* Release every resource held by a finished process */
+static void free_proc(struct pcb_t * proc) {
+	free(proc->code->text);
+	free(proc->code->ops);
+	free(proc->code);
 #ifdef MM_PAGING
-			for (int i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
-				if (proc->mm->symrgtbl[i] != NULL) {
-					free(proc->mm->symrgtbl[i]);
-				}
-			}
-			while (proc->mm->mmap->vm_freerg_list != NULL) {
-				struct vm_rg_struct *rg = proc->mm->mmap->vm_freerg_list;
-				proc->mm->mmap->vm_freerg_list = rg->rg_next;
-				free(rg);
-			}
-			int pgn_end = PAGING_PGN(proc->mm->mmap->sbrk);
-			for (int i = 0; i < pgn_end; i++) {
-				uint32_t pte = proc->mm->pgd[i];
-				if (PAGING_PAGE_PRESENT(pte)) {
-					int fpn = PAGING_FPN(pte);
-					if (MEMPHY_get_usedfp(proc->mram, fpn, RAM_LCK) == 0)
-						MEMPHY_put_freefp(proc->mram, fpn, RAM_LCK);
-				} else if (GETVAL(pte, PAGING_PTE_SWAPPED_MASK, 0) != 0) {
-					int fpn = PAGING_SWP(pte);
-					MEMPHY_put_freefp(proc->active_mswp, fpn, SWP_LCK);
-				}
-			}
-			free(proc->mm->pgd);
-			free(proc->mm->mmap);
-			free(proc->mm);
-#endif
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
-			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to ready queue\n",
-				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
+	for (int i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
+		if (proc->mm->symrgtbl[i] != NULL) {
+			free(proc->mm->symrgtbl[i]);
+		}
+	}
+	while (proc->mm->mmap->vm_freerg_list != NULL) {
+		struct vm_rg_struct *rg = proc->mm->mmap->vm_freerg_list;
+		proc->mm->mmap->vm_freerg_list = rg->rg_next;
+		free(rg);
+	}
+	int pgn_end = PAGING_PGN(proc->mm->mmap->sbrk);
+	for (int i = 0; i < pgn_end; i++) {
+		uint32_t pte = proc->mm->pgd[i];
+		if (PAGING_PAGE_PRESENT(pte)) {
+			int fpn = PAGING_FPN(pte);
+			if (MEMPHY_get_usedfp(proc->mram, fpn, RAM_LCK) == 0)
+				MEMPHY_put_freefp(proc->mram, fpn, RAM_LCK);
+		} else if (GETVAL(pte, PAGING_PTE_SWAPPED_MASK, 0) != 0) {
+			int fpn = PAGING_SWP(pte);
+			MEMPHY_put_freefp(proc->active_mswp, fpn, SWP_LCK);
 		}
-		
-		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
+	}
+	free(proc->mm->pgd);
+	free(proc->mm->mmap);
+	free(proc->mm);
+#endif
+	free(proc);
+}
+
+static void * cpu_routine(void * args);
+
+/* Process [proc] run by CPU [cpu] has finished its job */
+static void cpu_finish(struct cpu_args * cpu, struct pcb_t * proc) {
+	printf("\tCPU %d: Processed %2d has finished\n",
+		cpu->id, proc->pid);
+	cpu->nr_finished++;
+	cpu->turnaround += current_time() - proc->arrival;
+	struct quantum_band * band = &bands[prio_band[proc->prio]];
+	pthread_mutex_lock(&band_lock);
+	band->nr_procs++;
+	band->nr_switches += proc->nr_switches;
+	band->nr_inst += proc->run_time;
+	band->turnaround += current_time() - proc->arrival;
+	pthread_mutex_unlock(&band_lock);
+	sched_exit(cpu->id, proc);
+	free_proc(proc);
+}
+
+/* Park CPU [cpu], which found no process in its last step, unless work
+ * may have come in since then. Return 1 if the CPU has parked */
+static int cpu_park(struct cpu_args * cpu) {
+	pthread_mutex_lock(&park_lock);
+	if (done || !cpu->online || atomic_load(&work_gen) != cpu->idle_gen) {
+		pthread_mutex_unlock(&park_lock);
+		return 0;
+	}
+	cpu->parked = 1;
+	cpu->nr_parks++;
+	nr_parked++;
+	pthread_mutex_unlock(&park_lock);
+	if (engine == ENGINE_THREAD) {
+		/* Outside park_lock: the clock may move on here and run an
+		 * I/O completion, which wakes CPUs. An unpark coming first is
+		 * fine with the timer */
+		park_event(cpu->timer_id);
+	}
+	return 1;
+}
+
+/* Bring parked CPU [cpu] back from the next slot on. The serial and pool
+ * engines may already run it in the current slot. Called with park_lock
+ * held */
+static void cpu_unpark(struct cpu_args * cpu) {
+	if (!cpu->parked)
+		return;
+	cpu->parked = 0;
+	nr_parked--;
+	if (engine == ENGINE_THREAD) {
+		unpark_event(cpu->timer_id);
+	}
+}
+
+/* A process has become ready: wake the first parked CPU after CPU [from]
+ * in the order of IDs to run it. [from] is -1 for the loader */
+static void wake_idle_cpu(int from) {
+	int i;
+	pthread_mutex_lock(&park_lock);
+	atomic_fetch_add(&work_gen, 1);
+	for (i = 1; nr_parked > 0 && i <= max_cpus; i++) {
+		struct cpu_args * cpu = &cpu_list[(from + i + max_cpus) % max_cpus];
+		if (cpu->parked) {
+			cpu_unpark(cpu);
 			break;
-		}else if (proc == NULL) {
-			/* There may be new processes to run in
-			 * next time slots, just skip current slot */
-			next_slot(timer_id);
-			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			time_left = time_slot;
 		}
-		/* Run current process */
-		run(proc);
-		time_left--;
-		next_slot(timer_id);
+	}
+	pthread_mutex_unlock(&park_lock);
+}
+
+/* Bring stopped CPU [cpu] back to work from the next slot on. Called
+ * with hotplug_lock held */
+static void cpu_start(struct cpu_args * cpu) {
+	pthread_t thread;
+	/* The pool reads [wake] once it sees the CPU running */
+	cpu->wake = current_time() + 1;
+	cpu->stopped = 0;
+	if (engine == ENGINE_THREAD) {
+		/* The thread which ran the CPU before may still be on its way
+		 * out, it keeps its own timer event */
+		cpu->timer_id = attach_event();
+		nr_cpu_threads++;
+		pthread_create(&thread, NULL, cpu_routine, (void*)cpu);
+		pthread_detach(thread);
+	}else if (engine == ENGINE_POOL) {
+		atomic_fetch_add(&pool_alive, 1);
+	}
+}
+
+/* Stop CPU [cpu] if it is unplugged. Its process goes back to the ready
+ * queue, and if no online CPU is left to run it one is started again.
+ * Return 1 if the CPU has stopped */
+static int cpu_unplug(struct cpu_args * cpu) {
+	struct pcb_t * proc = cpu->proc;
+	int i;
+	pthread_mutex_lock(&hotplug_lock);
+	if (cpu->online) {
+		/* Plugged in again before it noticed */
+		pthread_mutex_unlock(&hotplug_lock);
+		return 0;
+	}
+	if (proc != NULL && proc->pc == proc->code->size) {
+		cpu_finish(cpu, proc);
+	}else if (proc != NULL) {
+		printf("\tCPU %d: Put process %2d to ready queue\n",
+			cpu->id, proc->pid);
+		put_proc(cpu->id, proc);
+		wake_idle_cpu(cpu->id);
+		for (i = 0; i < max_cpus; i++) {
+			if (cpu_list[i].online && !cpu_list[i].stopped)
+				break;
+		}
+		if (i == max_cpus) {
+			/* Every online CPU has stopped after the last load */
+			for (i = 0; !cpu_list[i].online; i++);
+			cpu_start(&cpu_list[i]);
+		}
+	}
+	cpu->proc = NULL;
+	cpu->time_left = 0;
+	cpu->stopped = 1;
+	printf("\tCPU %d unplugged\n", cpu->id);
+	pthread_mutex_unlock(&hotplug_lock);
+	return 1;
+}
+
+/* Stop CPU [cpu], which has run out of work after the last load. An
+ * unplugged CPU may have handed a process back in the meantime, then the
+ * CPU takes it instead. While a blocked process may still be woken the
+ * CPU idles instead. Return 1 if the CPU has stopped */
+static int cpu_stop(struct cpu_args * cpu) {
+	pthread_mutex_lock(&hotplug_lock);
+	cpu->proc = get_proc(cpu->id);
+	if (cpu->proc == NULL && sched_pending()) {
+		pthread_mutex_unlock(&hotplug_lock);
+		return 0;
+	}
+	if (cpu->proc == NULL) {
+		cpu->stopped = 1;
+		printf("\tCPU %d stopped\n", cpu->id);
+	}
+	pthread_mutex_unlock(&hotplug_lock);
+	return cpu->proc == NULL;
+}
+
+/* Do the job of CPU [cpu] in the current time slot. Return 1 if the CPU
+ * has stopped, otherwise return 0 and store in [wake] the first slot in
+ * which the CPU has something to do */
+static int cpu_step(struct cpu_args * cpu, uint64_t * wake) {
+	struct pcb_t * proc = cpu->proc;
+	int id = cpu->id;
+	cpu->idle_gen = atomic_load(&work_gen);
+	if (!cpu->online && cpu_unplug(cpu)) {
+		return 1;
+	}
+	if (preempt && proc != NULL && cpu->time_left > 0
+			&& atomic_exchange(&cpu->need_resched, 0)) {
+		/* Cut the quantum short for the process which has arrived */
+		printf("\tCPU %d: Preempted process %2d\n", id, proc->pid);
+		cpu->nr_preempted++;
+		cpu->time_left = 0;
+	}
+	/* Check the status of current process */
+	if (proc == NULL) {
+		/* No process is running, the we load new process from
+		 * ready queue */
+		proc = get_proc(cpu->id);
+	}else if (proc->pc == proc->code->size) {
+		/* The process has finish it job */
+		cpu_finish(cpu, proc);
+		proc = get_proc(cpu->id);
+		cpu->time_left = 0;
+	}else if (cpu->time_left == 0) {
+		/* The process has done its job in current time slot */
+		printf("\tCPU %d: Put process %2d to ready queue\n",
+			id, proc->pid);
+		put_proc(cpu->id, proc);
+		proc = get_proc(cpu->id);
+	}
+	cpu->proc = proc;
+
+	/* Recheck process status after loading new process */
+	if (proc == NULL && done && cpu_stop(cpu)) {
+		/* No process to run, exit */
+		return 1;
+	}
+	proc = cpu->proc;
+	if (proc == NULL) {
+		/* There may be new processes to run in
+		 * next time slots, just skip current slot */
+		if (preempt) {
+			atomic_store_explicit(&cpu->curr_prio, -1,
+				memory_order_relaxed);
+		}
+		*wake = TIMER_IDLE;
+		return 0;
+	}else if (cpu->time_left == 0) {
+		printf("\tCPU %d: Dispatched process %2d\n",
+			id, proc->pid);
+		cpu->time_left = bands[prio_band[proc->prio]].len;
+		proc->nr_switches++;
+#ifdef CPU_TLB
+		proc->tlb = &cpu->tlb;
+#endif
+		if (preempt) {
+			atomic_store(&cpu->need_resched, 0);
+			atomic_store_explicit(&cpu->curr_prio, proc->prio,
+				memory_order_relaxed);
+		}
+	}
+	/* Run current process. With batching, the instructions that follow
+	 * in this quantum run now as long as they touch no shared state,
+	 * which is checked right before each one, as an earlier one may
+	 * fill the TLB. Each one is charged to the policy as if it had its
+	 * own slot, so the batch ends where the policy would take the CPU
+	 * back. The CPU then sleeps through the slots they would have
+	 * taken. A batch is not lock-free: the TLB lookup of run_local and
+	 * the tick of the policy still take their locks, what it saves is
+	 * the slot barrier between the instructions */
+	int nr_inst = 0, stat, resched;
+	do {
+		stat = run(proc);
+		if (stat == RUN_WOKE) {
+			wake_idle_cpu(id);
+		}
+		nr_inst++;
+		resched = sched_tick(id, proc, 1);
+	} while (batch_calc && !resched && stat != RUN_BLOCKED
+		&& nr_inst < cpu->time_left && proc->pc < proc->code->size
+		&& run_local(proc));
+	cpu->time_left -= nr_inst;
+	/* Preemption and unplugging cut the quantum short later on, this is
+	 * the only place a quantum runs out */
+	proc->expired = cpu->time_left == 0;
+	if (resched) {
+		/* The policy takes the CPU back at the next step */
+		cpu->time_left = 0;
+	}
+	if (stat == RUN_BLOCKED) {
+		/* The process is in the wait queue of a kernel object now,
+		 * whoever releases the object puts it back */
+		printf("\tCPU %d: Process %2d blocked\n", id, proc->pid);
+		cpu->proc = NULL;
+		cpu->time_left = 0;
+		if (sched_release(id, proc))
+			wake_idle_cpu(id);
+	}
+	cpu->nr_inst += nr_inst;
+	*wake = current_time() + nr_inst;
+	return 0;
+}
+
+static void * cpu_routine(void * args) {
+	struct cpu_args * cpu = (struct cpu_args*)args;
+	/* Once the CPU stops, a new thread may take it over with a timer
+	 * event of its own */
+	struct timer_id_t * timer_id = cpu->timer_id;
+	uint64_t wake;
+	wait_event(timer_id);
+	while (!cpu_step(cpu, &wake)) {
+		if (wake == TIMER_IDLE && cpu_park(cpu)) {
+			/* Out of the clock until some work comes in */
+			wait_event(timer_id);
+		}else if (wake == TIMER_IDLE) {
+			next_slot_until(timer_id, wake);
+		}else{
+			next_slot_busy(timer_id, wake);
+		}
 	}
 	detach_event(timer_id);
+	pthread_mutex_lock(&hotplug_lock);
+	if (--nr_cpu_threads == 0) {
+		pthread_cond_signal(&cpu_threads_cond);
+	}
+	pthread_mutex_unlock(&hotplug_lock);
 	pthread_exit(NULL);
 }
 
-static void * ld_routine(void * args) {
+/* Take the totals of every CPU into [phase]. Called with hotplug_lock
+ * held while no CPU runs */
+static void take_phase(struct cpu_phase * phase) {
+	int i;
+	phase->nr_inst = phase->nr_finished = phase->turnaround = 0;
+	for (i = 0; i < max_cpus; i++) {
+		phase->nr_inst += cpu_list[i].nr_inst;
+		phase->nr_finished += cpu_list[i].nr_finished;
+		phase->turnaround += cpu_list[i].turnaround;
+	}
+	phase->pending = 0;
+}
+
+/* The clock has entered the first slot of phase [arg] */
+static void begin_phase(void * arg) {
+	pthread_mutex_lock(&hotplug_lock);
+	take_phase((struct cpu_phase *)arg);
+	pthread_mutex_unlock(&hotplug_lock);
+}
+
+/* Start a new phase of the run with [n] online CPUs from the next slot
+ * on. Called with hotplug_lock held. CPUs on other threads may still run
+ * the current slot, so the counters are taken by a clock callback at the
+ * slot barrier */
+static void open_phase(int n) {
+	struct cpu_phase * phase = &phases[num_phases++];
+	phase->start = current_time() + 1;
+	phase->num_cpus = n;
+	phase->pending = 1;
+	timer_at(phase->start, begin_phase, phase);
+}
+
+/* Plug in or out CPUs so that the CPUs with ID below [n] are online. An
+ * unplugged CPU stops at its next step */
+static void set_online_cpus(int n) {
+	int i;
+	pthread_mutex_lock(&hotplug_lock);
+	open_phase(n);
+	printf("\tHot-plug: %d CPUs online\n", n);
+	for (i = 0; i < max_cpus; i++) {
+		struct cpu_args * cpu = &cpu_list[i];
+		if (i >= n) {
+			cpu->online = 0;
+			/* It has to step to notice */
+			pthread_mutex_lock(&park_lock);
+			cpu_unpark(cpu);
+			pthread_mutex_unlock(&park_lock);
+		}else if (!cpu->online) {
+			cpu->online = 1;
+			if (cpu->stopped) {
+				cpu_start(cpu);
+			}
+		}
+	}
+	pthread_mutex_unlock(&hotplug_lock);
+}
+
+/* Print context switches and throughput of every priority band */
+static void print_band_stat(void) {
+	uint64_t slots = current_time() > 0 ? current_time() : 1;
+	int i;
+	for (i = 0; i < num_bands; i++) {
+		struct quantum_band * b = &bands[i];
+		if (i == 0 && b->nr_procs == 0)
+			continue;
+		if (i == 0) {
+			printf("Band other   ");
+		}else{
+			printf("Band %3d-%3d", b->lo, b->hi);
+		}
+		printf(" (quantum %2d): %lu processes, %lu switches "
+			"(%.1f per process), %lu instructions, "
+			"%.2f finished per 100 slots, avg turnaround %.1f slots\n",
+			b->len, b->nr_procs, b->nr_switches,
+			b->nr_procs > 0 ? (double)b->nr_switches / b->nr_procs : 0.0,
+			b->nr_inst, 100.0 * b->nr_procs / slots,
+			b->nr_procs > 0 ? (double)b->turnaround / b->nr_procs : 0.0);
+	}
+}
+
+/* Print throughput and latency of every phase of the run */
+static void print_cpu_stat(void) {
+	struct cpu_phase end;
+	unsigned long nr_preempted = 0, nr_parks = 0;
+	double secs = timer_elapsed();
+	int i;
+	/* Every CPU is done: a phase opened in the last slot has not seen
+	 * its callback */
+	pthread_mutex_lock(&hotplug_lock);
+	for (i = 0; i < num_phases; i++) {
+		if (phases[i].pending)
+			take_phase(&phases[i]);
+	}
+	end.start = current_time();
+	take_phase(&end);
+	pthread_mutex_unlock(&hotplug_lock);
+	for (i = 0; i < num_phases; i++) {
+		struct cpu_phase * next = i + 1 < num_phases ? &phases[i + 1] : &end;
+		unsigned long slots = next->start - phases[i].start;
+		unsigned long nr_inst = next->nr_inst - phases[i].nr_inst;
+		unsigned long nr_finished = next->nr_finished - phases[i].nr_finished;
+		printf("CPUs: %3d from slot %3lu, %lu slots, %lu instructions "
+			"(%.2f/slot), %lu finished (avg turnaround %.1f slots)\n",
+			phases[i].num_cpus, phases[i].start, slots, nr_inst,
+			slots > 0 ? (double)nr_inst / slots : 0.0, nr_finished,
+			nr_finished > 0 ? (double)(next->turnaround
+				- phases[i].turnaround) / nr_finished : 0.0);
+	}
+	for (i = 0; i < max_cpus; i++) {
+		nr_preempted += cpu_list[i].nr_preempted;
+		nr_parks += cpu_list[i].nr_parks;
+	}
+	printf("Instructions: %lu in %.3f s (%.0f per sec)\n", end.nr_inst,
+		secs, secs > 0 ? end.nr_inst / secs : 0.0);
+	printf("Idle CPUs parked %lu times\n", nr_parks);
+	if (preempt) {
+		printf("Preemptions: %lu\n", nr_preempted);
+	}
+}
+
+/* New process [proc] is ready: unless some CPU is idle, ask the CPU
+ * running the process of lowest priority to give it up at its next step
+ * if [proc] has a better priority. Which process runs then is up to the
+ * scheduler policy. hotplug_lock keeps the set of running CPUs still */
+static void preempt_for(struct pcb_t * proc) {
+	struct cpu_args * victim = NULL;
+	int i, prio, worst = proc->prio;
+	pthread_mutex_lock(&hotplug_lock);
+	for (i = 0; i < max_cpus; i++) {
+		if (cpu_list[i].stopped)
+			continue;
+		prio = atomic_load_explicit(&cpu_list[i].curr_prio,
+			memory_order_relaxed);
+		if (prio < 0) {
+			victim = NULL;
+			break;
+		}
+		if (prio > worst) {
+			worst = prio;
+			victim = &cpu_list[i];
+		}
+	}
+	if (victim != NULL) {
+		atomic_store(&victim->need_resched, 1);
+	}
+	pthread_mutex_unlock(&hotplug_lock);
+}
+
+/* Do the job of the loader in the current time slot: apply the CPU
+ * hot-plug events and load at most one process whose time has come.
+ * Return 1 once every process has been loaded and every event applied,
+ * otherwise return 0 and store in [wake] the first slot in which the
+ * loader has something to do */
+static int ld_step(void * args, uint64_t * wake) {
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
 	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
 	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
-	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
-#else
-	struct timer_id_t * timer_id = (struct timer_id_t*)args;
-#endif
-#ifdef CPU_TLB
-	struct memphy_struct *tlb = ((struct mmpaging_ld_args *)args)->tlb;
-#endif
-	int i = 0;
-	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
-#ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
 #endif
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
+	int i = ld_next;
+	int ev;
+	while ((ev = atomic_load(&next_cpu_event)) < num_cpu_events
+			&& cpu_events[ev].time <= current_time()) {
+		set_online_cpus(cpu_events[ev].num_cpus);
+		atomic_store(&next_cpu_event, ev + 1);
+	}
+	if (i == num_processes) {
+		if (!done) {
+			int c;
+			free(ld_processes.path);
+			free(ld_processes.start_time);
+			free(ld_processes.prio);
+			free(ld_processes.deadline);
+			/* Parked CPUs have to step to stop */
+			pthread_mutex_lock(&park_lock);
+			done = 1;
+			for (c = 0; c < max_cpus; c++) {
+				cpu_unpark(&cpu_list[c]);
+			}
+			pthread_mutex_unlock(&park_lock);
+		}
+		if (ev < num_cpu_events) {
+			*wake = cpu_events[ev].time;
+			return 0;
 		}
+		return 1;
+	}
+	if (current_time() < ld_processes.start_time[i]) {
+		*wake = ld_processes.start_time[i];
+		if (ev < num_cpu_events && cpu_events[ev].time < *wake) {
+			*wake = cpu_events[ev].time;
+		}
+		return 0;
+	}
+	struct pcb_t * proc = load(ld_processes.path[i]);
+	proc->arrival = current_time();
+	proc->last_cpu = -1;
+	proc->nr_switches = 0;
+	proc->prio = ld_processes.prio[i];
+	proc->deadline = ld_processes.deadline[i] > 0
+		? ld_processes.start_time[i] + ld_processes.deadline[i] : 0;
 #ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
+	proc->mm = malloc(sizeof(struct mm_struct));
+	init_mm(proc->mm, proc);
+	proc->mram = mram;
+	proc->mswp = mswp;
+	proc->active_mswp = active_mswp;
 #endif
 #ifdef CPU_TLB
-		proc->tlb = tlb;
+	/* Every dispatch hands it the TLB of its CPU */
+	proc->tlb = NULL;
 #endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
-		next_slot(timer_id);
-	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+		ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+	add_proc(proc);
+	wake_idle_cpu(-1);
+	if (preempt) {
+		preempt_for(proc);
+	}
+	free(ld_processes.path[i]);
+	ld_next++;
+	*wake = current_time() + 1;
+	return 0;
+}
+
+static void * ld_routine(void * args) {
+	uint64_t wake;
+	printf("ld_routine\n");
+	while (!ld_step(args, &wake)) {
+		next_slot_until(ld_event, wake);
+	}
+	detach_event(ld_event);
+	pthread_exit(NULL);
+}
+
+/* Threaded engine: one host thread per CPU plus one for the loader, all
+ * lock-stepped by the timer */
+static void run_threads(struct cpu_args * cpus, void * ld_args) {
+	pthread_t cpu;
+	pthread_t ld;
+	int i;
+
+	for (i = 0; i < num_cpus; i++) {
+		cpus[i].timer_id = attach_event();
+	}
+	ld_event = attach_event();
+	start_timer();
+
+	/* Run CPU and loader. CPU threads come and go with hot-plug, so
+	 * they are detached and counted instead of joined */
+	pthread_create(&ld, NULL, ld_routine, ld_args);
+	pthread_mutex_lock(&hotplug_lock);
+	for (i = 0; i < num_cpus; i++) {
+		nr_cpu_threads++;
+		pthread_create(&cpu, NULL,
+			cpu_routine, (void*)&cpus[i]);
+		pthread_detach(cpu);
+	}
+	pthread_mutex_unlock(&hotplug_lock);
+
+	/* Wait for CPU and loader finishing. Only the loader and running
+	 * CPUs start CPUs, so no thread is left once both are gone */
+	pthread_join(ld, NULL);
+	pthread_mutex_lock(&hotplug_lock);
+	while (nr_cpu_threads > 0) {
+		pthread_cond_wait(&cpu_threads_cond, &hotplug_lock);
+	}
+	pthread_mutex_unlock(&hotplug_lock);
+}
+
+/* Serial engine: the loader and then every CPU in the order of their ID
+ * do their job of a slot on the calling thread, which makes the log of a
+ * run reproducible */
+static void run_serial(struct cpu_args * cpus, void * ld_args) {
+	struct timer_id_t * timer_id = attach_event();
+	int ld_stopped = 0;
+	uint64_t ld_wake = 0;
+	int alive;
+	int i;
+
+	start_timer();
+	printf("ld_routine\n");
+	while (1) {
+		uint64_t wake = TIMER_IDLE;
+		int busy = 0;
+		if (!ld_stopped) {
+			if (current_time() < ld_wake) {
+				/* Waiting for the start time of the next process */
+			}else if (ld_step(ld_args, &ld_wake)) {
+				ld_stopped = 1;
+			}
+			if (!ld_stopped && ld_wake < wake) {
+				wake = ld_wake;
+			}
+		}
+		alive = !ld_stopped;
+		for (i = 0; i < max_cpus; i++) {
+			if (cpus[i].stopped)
+				continue;
+			if (cpus[i].parked) {
+				alive++;
+				continue;
+			}
+			if (cpus[i].wake != TIMER_IDLE
+					&& current_time() < cpus[i].wake) {
+				/* Still busy with a batch of instructions */
+			}else if (cpu_step(&cpus[i], &cpus[i].wake)) {
+				continue;
+			}else if (cpus[i].wake == TIMER_IDLE) {
+				cpu_park(&cpus[i]);
+			}
+			alive++;
+			if (cpus[i].wake != TIMER_IDLE) {
+				busy = 1;
+			}
+			if (cpus[i].wake < wake) {
+				wake = cpus[i].wake;
+			}
+		}
+		/* With hot-plug, a CPU may have been started again by one
+		 * after it, it runs from the next slot on */
+		for (i = 0; num_cpu_events > 0 && i < max_cpus; i++) {
+			if (!cpus[i].stopped && cpus[i].wake < wake) {
+				wake = cpus[i].wake;
+				alive = 1;
+			}
+		}
+		if (alive == 0)
+			break;
+		if (busy) {
+			next_slot_busy(timer_id, wake);
+		}else{
+			next_slot_until(timer_id, wake);
+		}
+	}
 	detach_event(timer_id);
+}
+
+/* Run every CPU of [victim] that has not been taken yet in this slot */
+static void pool_run_range(struct pool_worker * victim) {
+	uint64_t wake = TIMER_IDLE, cur;
+	int i;
+	while ((i = atomic_fetch_add(&victim->next, 1)) < victim->end) {
+		struct cpu_args * cpu = &cpu_list[i];
+		if (cpu->stopped || cpu->parked)
+			continue;
+		if (cpu->wake != TIMER_IDLE && current_time() < cpu->wake) {
+			/* Still busy with a batch of instructions */
+		}else if (cpu_step(cpu, &cpu->wake)) {
+			atomic_fetch_sub(&pool_alive, 1);
+			continue;
+		}else if (cpu->wake == TIMER_IDLE) {
+			cpu_park(cpu);
+		}
+		if (cpu->wake != TIMER_IDLE) {
+			atomic_store(&pool_busy, 1);
+		}
+		if (cpu->wake < wake) {
+			wake = cpu->wake;
+		}
+	}
+	cur = atomic_load(&pool_wake);
+	while (wake < cur
+		&& !atomic_compare_exchange_weak(&pool_wake, &cur, wake));
+}
+
+static void * pool_routine(void * args) {
+	struct pool_worker * w = (struct pool_worker*)args;
+	int v;
+	while (1) {
+		/* Own CPUs first, then steal from the other workers */
+		for (v = 0; v < num_workers; v++) {
+			pool_run_range(&workers[(w->id + v) % num_workers]);
+		}
+		/* Every CPU has done its slot: one worker moves the pool to the
+		 * next slot on behalf of all of them */
+		if (pthread_barrier_wait(&pool_barrier)
+				== PTHREAD_BARRIER_SERIAL_THREAD) {
+			/* Keep the pool while hot-plug may start CPUs again */
+			if (atomic_load(&pool_alive) == 0 && atomic_load(
+					&next_cpu_event) == num_cpu_events) {
+				detach_event(pool_event);
+				pool_exit = 1;
+			}else if (atomic_exchange(&pool_busy, 0)) {
+				next_slot_busy(pool_event,
+					atomic_exchange(&pool_wake, TIMER_IDLE));
+			}else{
+				next_slot_until(pool_event,
+					atomic_exchange(&pool_wake, TIMER_IDLE));
+			}
+			for (v = 0; v < num_workers; v++) {
+				atomic_store(&workers[v].next, workers[v].start);
+			}
+		}
+		pthread_barrier_wait(&pool_barrier);
+		if (pool_exit)
+			break;
+	}
 	pthread_exit(NULL);
 }
 
+/* Pool engine: the CPUs are spread over a fixed number of host workers,
+ * one per host core by default. The whole pool is a single device of
+ * the timer, the loader keeps a thread of its own */
+static void run_pool(struct cpu_args * cpus, void * ld_args) {
+	pthread_t ld;
+	int i;
+
+	if (num_workers <= 0) {
+		num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (num_workers > max_cpus) {
+		num_workers = max_cpus;
+	}
+	workers = (struct pool_worker*)malloc(
+		sizeof(struct pool_worker) * num_workers);
+	for (i = 0; i < num_workers; i++) {
+		workers[i].id = i;
+		workers[i].start = max_cpus * i / num_workers;
+		workers[i].end = max_cpus * (i + 1) / num_workers;
+		atomic_init(&workers[i].next, workers[i].start);
+	}
+	atomic_init(&pool_alive, num_cpus);
+	atomic_init(&pool_wake, TIMER_IDLE);
+	atomic_init(&pool_busy, 0);
+	pthread_barrier_init(&pool_barrier, NULL, num_workers);
+
+	pool_event = attach_event();
+	ld_event = attach_event();
+	start_timer();
+
+	pthread_create(&ld, NULL, ld_routine, ld_args);
+	for (i = 0; i < num_workers; i++) {
+		pthread_create(&workers[i].thread, NULL,
+			pool_routine, (void*)&workers[i]);
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	pthread_join(ld, NULL);
+	pthread_barrier_destroy(&pool_barrier);
+	free(workers);
+}
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
@@ -228,56 +973,219 @@ static void read_config(const char * path) {
 #endif
 #endif
 
-#ifdef MLQ_SCHED
 	ld_processes.prio = (unsigned long*)
 		malloc(sizeof(unsigned long) * num_processes);
-#endif
+	ld_processes.deadline = (unsigned long*)
+		calloc(num_processes, sizeof(unsigned long));
 	int i;
 	for (i = 0; i < num_processes; i++) {
 		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
 		ld_processes.path[i][0] = '\0';
 		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
-#ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
-#endif
+		char proc[80];
+		char line[256];
+		/* [start time] [program] [priority] [deadline], the deadline
+		 * is optional and counts slots from the start time */
+		do {
+			if (fgets(line, sizeof(line), file) == NULL) {
+				line[0] = '\0';
+				break;
+			}
+		} while (strspn(line, " \t\r\n") == strlen(line));
+		ld_processes.prio[i] = 0;
+		if (sscanf(line, "%lu %79s %lu %lu", &ld_processes.start_time[i],
+				proc, &ld_processes.prio[i],
+				&ld_processes.deadline[i]) < 2) {
+			printf("Invalid process line in %s\n", path);
+			exit(1);
+		}
 		strcat(ld_processes.path[i], proc);
 	}
+
+	/* Optional directives after the process list, one per line:
+	 *        cpus [time slot] [N = Number of CPU from this slot on]
+	 *        sched [scheduler policy]
+	 *        mem [memory backend: tlb, paging or legacy]
+	 *        quantum [lowest prio] [highest prio] [time slice]
+	 *        affinity [priority window of cache-hot dispatches]
+	 * A later quantum directive overrides the earlier ones where they
+	 * overlap
+	 */
+	char key[100];
+	max_cpus = num_cpus;
+	bands = (struct quantum_band*)calloc(1, sizeof(struct quantum_band));
+	bands[0].lo = 0;
+	bands[0].hi = MAX_PRIO - 1;
+	bands[0].len = time_slot;
+	while (fscanf(file, "%99s", key) == 1) {
+		if (!strcmp(key, "cpus")) {
+			struct cpu_event ev;
+			if (fscanf(file, "%lu %d", &ev.time, &ev.num_cpus) != 2
+					|| ev.num_cpus < 1) {
+				printf("Invalid cpus directive in %s\n", path);
+				exit(1);
+			}
+			if (ev.num_cpus > max_cpus) {
+				max_cpus = ev.num_cpus;
+			}
+			/* Keep the events sorted by time */
+			cpu_events = (struct cpu_event*)realloc(cpu_events,
+				sizeof(struct cpu_event) * (num_cpu_events + 1));
+			for (i = num_cpu_events; i > 0
+					&& cpu_events[i - 1].time > ev.time; i--) {
+				cpu_events[i] = cpu_events[i - 1];
+			}
+			cpu_events[i] = ev;
+			num_cpu_events++;
+		}else if (!strcmp(key, "sched")) {
+			fscanf(file, "%99s", sched_name);
+		}else if (!strcmp(key, "mem")) {
+			fscanf(file, "%99s", mem_name);
+		}else if (!strcmp(key, "quantum")) {
+			struct quantum_band * b;
+			int lo, hi, len, prio;
+			if (fscanf(file, "%d %d %d", &lo, &hi, &len) != 3
+					|| lo < 0 || hi >= MAX_PRIO || lo > hi
+					|| len < 1) {
+				printf("Invalid quantum directive in %s\n", path);
+				exit(1);
+			}
+			bands = (struct quantum_band*)realloc(bands,
+				sizeof(struct quantum_band) * (num_bands + 1));
+			b = &bands[num_bands];
+			memset(b, 0, sizeof(struct quantum_band));
+			b->lo = lo;
+			b->hi = hi;
+			b->len = len;
+			for (prio = lo; prio <= hi; prio++) {
+				prio_band[prio] = num_bands;
+			}
+			num_bands++;
+		}else if (!strcmp(key, "affinity")) {
+			int window;
+			if (fscanf(file, "%d", &window) != 1 || window < 0) {
+				printf("Invalid affinity directive in %s\n", path);
+				exit(1);
+			}
+			set_affinity(window);
+		}else if (!strcmp(key, "sem")) {
+			uint32_t id;
+			int value;
+			if (fscanf(file, "%u %d", &id, &value) != 2 || value < 0
+					|| sem_init(id, value) < 0) {
+				printf("Invalid sem directive in %s\n", path);
+				exit(1);
+			}
+		}else{
+			printf("Unknown directive '%s' in %s\n", key, path);
+			exit(1);
+		}
+	}
+	fclose(file);
 }
 
 int main(int argc, char * argv[]) {
-	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	/* Read options and config */
+	const char * policy = NULL;
+	const char * backend = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "sdbPS:m:e:w:")) != -1) {
+		switch (opt) {
+		case 's':
+			/* Print statistics of the run at exit */
+			print_stat = 1;
+			mem_account(1);
+			sched_account(1);
+			break;
+		case 'd':
+			/* Event-driven clock, skip slots without work */
+			set_event_driven(1);
+			break;
+		case 'b':
+			/* Run CALC instructions and TLB hits of a quantum in
+			 * one batch */
+			batch_calc = 1;
+			break;
+		case 'P':
+			/* Preempt a worse process when a new one arrives */
+			preempt = 1;
+			break;
+		case 'S':
+			/* Scheduler policy, overrides the one of the config */
+			policy = optarg;
+			break;
+		case 'm':
+			/* Memory backend, overrides the one of the config */
+			backend = optarg;
+			break;
+		case 'e':
+			/* Engine running CPUs and loader */
+			if (!strcmp(optarg, "thread")) {
+				engine = ENGINE_THREAD;
+			}else if (!strcmp(optarg, "serial")) {
+				engine = ENGINE_SERIAL;
+			}else if (!strcmp(optarg, "pool")) {
+				engine = ENGINE_POOL;
+			}else{
+				printf(USAGE);
+				return 1;
+			}
+			break;
+		case 'w':
+			/* Number of host workers of the pool engine */
+			num_workers = atoi(optarg);
+			break;
+		default:
+			printf(USAGE);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		printf(USAGE);
 		return 1;
 	}
 	char path[100];
 	path[0] = '\0';
 	strcat(path, "input/");
-	strcat(path, argv[1]);
+	strcat(path, argv[optind]);
 	read_config(path);
+	if (policy == NULL && sched_name[0] != '\0') {
+		policy = sched_name;
+	}
+	if (policy != NULL && set_scheduler(policy) < 0) {
+		printf("Unknown scheduler policy %s\n", policy);
+		return 1;
+	}
+	if (backend == NULL && mem_name[0] != '\0') {
+		backend = mem_name;
+	}
+	if (backend != NULL && set_mem_backend(backend) < 0) {
+		printf("Unknown memory backend %s\n", backend);
+		return 1;
+	}
 
-	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
-		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
-	pthread_t ld;
-	
-	/* Init timer */
+		(struct cpu_args*)calloc(max_cpus, sizeof(struct cpu_args));
 	int i;
-	for (i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
+	for (i = 0; i < max_cpus; i++) {
 		args[i].id = i;
-	}
-	struct timer_id_t * ld_event = attach_event();
-	start_timer();
+		args[i].proc = NULL;
+		atomic_init(&args[i].online, i < num_cpus);
+		atomic_init(&args[i].stopped, i >= num_cpus);
+		atomic_init(&args[i].curr_prio, -1);
+		atomic_init(&args[i].need_resched, 0);
+		atomic_init(&args[i].parked, 0);
 #ifdef CPU_TLB
-	struct memphy_struct tlb;
-
-	init_tlbmemphy(&tlb, tlbsz);
+		init_tlbmemphy(&args[i].tlb, tlbsz);
 #endif
-
+	}
+	cpu_list = args;
+	phases = (struct cpu_phase*)malloc(
+		sizeof(struct cpu_phase) * (num_cpu_events + 1));
+	phases[0].start = 0;
+	phases[0].num_cpus = num_cpus;
+	take_phase(&phases[0]);
+	num_phases = 1;
 #ifdef MM_PAGING
 	/* Init all MEMPHY include 1 MEMRAM and n of MEMSWP */
 	int rdmflag = 1; /* By default memphy is RANDOM ACCESS MEMORY */
@@ -298,49 +1206,54 @@ int main(int argc, char * argv[]) {
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
 
-	mm_ld_args->timer_id = ld_event;
 	mm_ld_args->mram = (struct memphy_struct *) &mram;
 	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
 	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
 #endif
 
-#ifdef CPU_TLB
-#ifdef MM_PAGING
-	/* In MM_PAGING employ CPU_TLB mode, it needs passing
-	 * the system tlb to each PCB through loader
-	*/
-	mm_ld_args->tlb = (struct memphy_struct *) &tlb;
-#endif
-#endif
-
-	/* Init scheduler */
-	init_scheduler();
+	/* Init scheduler and memory backend */
+	init_scheduler(max_cpus);
+	init_mem_backend();
+	/* An I/O completion or a wakeup may need a parked CPU to run the
+	 * process */
+	set_ready_notify(wake_idle_cpu);
 
 	/* Run CPU and loader */
 #ifdef MM_PAGING
-	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
+	void * ld_args = (void*)mm_ld_args;
 #else
-	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
+	void * ld_args = NULL;
 #endif
-	for (i = 0; i < num_cpus; i++) {
-		pthread_create(&cpu[i], NULL,
-			cpu_routine, (void*)&args[i]);
-	}
-
-	/* Wait for CPU and loader finishing */
-	for (i = 0; i < num_cpus; i++) {
-		pthread_join(cpu[i], NULL);
+	if (engine == ENGINE_SERIAL) {
+		run_serial(args, ld_args);
+	}else if (engine == ENGINE_POOL) {
+		run_pool(args, ld_args);
+	}else{
+		run_threads(args, ld_args);
 	}
-	pthread_join(ld, NULL);
 
 	/* Stop timer */
 	stop_timer();
+	if (print_stat) {
+		print_timer_stat();
+		print_cpu_stat();
+		print_sched_stat();
+		print_band_stat();
+		print_mem_stat();
+#ifdef CPU_TLB
+		print_tlb_stat();
+#endif
+	}
+	finish_scheduler();
 #ifdef MM_PAGING
 	destroy_memphy_lock();
 	destroy_memphy(&mram);
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
 		destroy_memphy(&mswp[sit]);
-	destroy_tlbmemphy(&tlb);
+#endif
+#ifdef CPU_TLB
+	for (i = 0; i < max_cpus; i++)
+		destroy_tlbmemphy(&cpu_list[i].tlb);
 #endif
 	return 0;
 
@@ -0,0 +1,63 @@
+
+#include "pheap.h"
+
+void pheap_init(struct pheap * heap, pheap_less_t less) {
+	heap->root = NULL;
+	heap->less = less;
+	heap->size = 0;
+}
+
+/* Merge the two roots [a] and [b], both may be NULL */
+static struct pheap_node * pheap_meld(struct pheap * heap,
+		struct pheap_node * a, struct pheap_node * b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+	if (heap->less(b, a)) {
+		struct pheap_node * t = a;
+		a = b;
+		b = t;
+	}
+	b->next = a->child;
+	a->child = b;
+	return a;
+}
+
+void pheap_insert(struct pheap * heap, struct pheap_node * node) {
+	node->child = NULL;
+	node->next = NULL;
+	heap->root = pheap_meld(heap, heap->root, node);
+	heap->size++;
+}
+
+struct pheap_node * pheap_pop(struct pheap * heap) {
+	struct pheap_node * top = heap->root;
+	struct pheap_node * pairs = NULL, * node, * root = NULL;
+	if (top == NULL)
+		return NULL;
+	/* Two-pass pairing: meld the children pairwise from left to right,
+	 * stacking the results, then meld the stack into one tree */
+	node = top->child;
+	while (node != NULL) {
+		struct pheap_node * a = node, * b = node->next;
+		node = b != NULL ? b->next : NULL;
+		a->next = NULL;
+		if (b != NULL)
+			b->next = NULL;
+		a = pheap_meld(heap, a, b);
+		a->next = pairs;
+		pairs = a;
+	}
+	while (pairs != NULL) {
+		node = pairs;
+		pairs = pairs->next;
+		node->next = NULL;
+		root = pheap_meld(heap, root, node);
+	}
+	heap->root = root;
+	heap->size--;
+	top->child = NULL;
+	return top;
+}
+
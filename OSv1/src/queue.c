@@ -1,3 +1,4 @@
+
 #include <stdio.h>
 #include <stdlib.h>
 #include "queue.h"
@@ -8,24 +9,54 @@ int empty(struct queue_t * q)
 	return (q->size == 0);
 }
 
+/* Double the capacity of [q], unrolling the wrapped part of the ring to
+ * the end of the old buffer */
+static void grow_queue(struct queue_t * q)
+{
+	int cap = q->cap == 0 ? MIN_QUEUE_SIZE : q->cap * 2;
+	q->proc = (struct pcb_t **)realloc(q->proc, sizeof(struct pcb_t *) * cap);
+	if (q->head + q->size > q->cap) {
+		int wrapped = q->head + q->size - q->cap;
+		int i;
+		for (i = 0; i < wrapped; i++) {
+			q->proc[q->cap + i] = q->proc[i];
+		}
+	}
+	q->cap = cap;
+}
+
 void enqueue(struct queue_t * q, struct pcb_t * proc) 
 {
         /* TODO: put a new process to queue [q] */
-        if (q == NULL || q->size >= MAX_QUEUE_SIZE) return;
-        q->proc[q->size] = proc;
-        q->size++;
+        if (q == NULL) return;
+	if (q->size == q->cap) {
+		grow_queue(q);
+	}
+	q->proc[(q->head + q->size) & (q->cap - 1)] = proc;
+	q->size++;
 }
 
 struct pcb_t * dequeue(struct queue_t * q) 
 {
         if (q == NULL || q->size == 0) 
                 return NULL;
-        struct pcb_t * proc = q->proc[0];
-        for (int i = 0; i < q->size - 1; i++) {
-                q->proc[i] = q->proc[i + 1];
-        }
-        q->size--;
-        q->proc[q->size] = NULL;
-        return proc;
+	struct pcb_t * proc = q->proc[q->head];
+	q->head = (q->head + 1) & (q->cap - 1);
+	q->size--;
+	return proc;
+}
+
+struct pcb_t * queue_head(struct queue_t * q)
+{
+	if (q == NULL || q->size == 0)
+		return NULL;
+	return q->proc[q->head];
+}
+
+void free_queue(struct queue_t * q)
+{
+	free(q->proc);
+	q->proc = NULL;
+	q->head = q->size = q->cap = 0;
 }
 
@@ -0,0 +1,114 @@
+
+#include "sched-class.h"
+#include <pthread.h>
+
+/* Completely fair scheduler: the process which has received the least
+ * CPU time, weighted by its priority, runs next. The ready processes sit
+ * in a pairing heap keyed by their virtual run time */
+static struct pheap cfs_queue;
+static pthread_mutex_t cfs_lock;
+static uint64_t min_vruntime;	// Virtual run time of the last dispatch
+
+/* A woken process lags behind min_vruntime by at most this many slots at
+ * nice 0, as sched_latency in Linux */
+#define CFS_SCHED_LATENCY	4
+
+/* Weight of nice levels -20 .. 19, as in Linux: every level is worth
+ * about 10% of CPU time */
+#define NICE_0_LOAD	1024
+static const int prio_to_weight[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	 9548,  7620,  6100,  4904,  3906,
+	 3121,  2501,  1991,  1586,  1277,
+	 1024,   820,   655,   526,   423,
+	  335,   272,   215,   172,   137,
+	  110,    87,    70,    56,    45,
+	   36,    29,    23,    18,    15,
+};
+
+/* The priorities 0 .. MAX_PRIO - 1 map evenly on the nice levels */
+static int cfs_weight(struct pcb_t * proc) {
+	return prio_to_weight[proc->prio * 40 / MAX_PRIO];
+}
+
+static int cfs_less(struct pheap_node * a, struct pheap_node * b) {
+	struct pcb_t * pa = container_of(a, struct pcb_t, run_node);
+	struct pcb_t * pb = container_of(b, struct pcb_t, run_node);
+	if (pa->vruntime != pb->vruntime)
+		return pa->vruntime < pb->vruntime;
+	return pa->pid < pb->pid;
+}
+
+static void cfs_init(int num_cpus) {
+	pheap_init(&cfs_queue, cfs_less);
+	pthread_mutex_init(&cfs_lock, NULL);
+	min_vruntime = 0;
+}
+
+static void cfs_finish(void) {
+	pthread_mutex_destroy(&cfs_lock);
+}
+
+static struct pcb_t * cfs_get(int cpu) {
+	struct pheap_node * node;
+	struct pcb_t * proc = NULL;
+	sched_lock(&cfs_lock, cpu);
+	node = pheap_pop(&cfs_queue);
+	if (node != NULL) {
+		proc = container_of(node, struct pcb_t, run_node);
+		if (proc->vruntime > min_vruntime)
+			min_vruntime = proc->vruntime;
+	}
+	pthread_mutex_unlock(&cfs_lock);
+	return proc;
+}
+
+static void cfs_put(int cpu, struct pcb_t * proc) {
+	sched_lock(&cfs_lock, cpu);
+	pheap_insert(&cfs_queue, &proc->run_node);
+	pthread_mutex_unlock(&cfs_lock);
+}
+
+/* A process back from a lock wait, an I/O or a sleep still has the
+ * virtual run time it blocked with, which would let it hog the CPUs
+ * until it caught up. It comes back at most CFS_SCHED_LATENCY behind */
+static void cfs_wake(int cpu, struct pcb_t * proc) {
+	uint64_t floor;
+	sched_lock(&cfs_lock, cpu);
+	floor = min_vruntime > (CFS_SCHED_LATENCY << 10)
+		? min_vruntime - (CFS_SCHED_LATENCY << 10) : 0;
+	if (proc->vruntime < floor)
+		proc->vruntime = floor;
+	pheap_insert(&cfs_queue, &proc->run_node);
+	pthread_mutex_unlock(&cfs_lock);
+}
+
+/* A new process starts level with the others instead of at zero, which
+ * would let it hog the CPUs until it caught up */
+static void cfs_add(struct pcb_t * proc) {
+	sched_lock(&cfs_lock, -1);
+	proc->vruntime = min_vruntime;
+	pheap_insert(&cfs_queue, &proc->run_node);
+	pthread_mutex_unlock(&cfs_lock);
+}
+
+/* [proc] is off the heap while it runs, so no lock is needed. The virtual
+ * run time counts 1/1024 of a slot at nice 0 */
+static int cfs_tick(int cpu, struct pcb_t * proc, int nr_slots) {
+	proc->vruntime += ((uint64_t)nr_slots * NICE_0_LOAD << 10)
+		/ cfs_weight(proc);
+	return 0;
+}
+
+struct sched_class cfs_sched_class = {
+	.name = "cfs",
+	.init = cfs_init,
+	.finish = cfs_finish,
+	.add = cfs_add,
+	.put = cfs_put,
+	.wake = cfs_wake,
+	.get = cfs_get,
+	.tick = cfs_tick,
+};
+
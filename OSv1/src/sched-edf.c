@@ -0,0 +1,89 @@
+
+#include "sched-class.h"
+#include <pthread.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+/* Earliest deadline first: the processes with a deadline sit in a
+ * pairing heap keyed by their deadline and always run before the others,
+ * which MLQ schedules as usual */
+static struct pheap edf_queue;
+static pthread_mutex_t edf_lock;
+static atomic_int nr_edf;	// Processes in edf_queue, read without the lock
+static unsigned long nr_edf_dispatches;
+
+static int edf_less(struct pheap_node * a, struct pheap_node * b) {
+	struct pcb_t * pa = container_of(a, struct pcb_t, run_node);
+	struct pcb_t * pb = container_of(b, struct pcb_t, run_node);
+	if (pa->deadline != pb->deadline)
+		return pa->deadline < pb->deadline;
+	return pa->pid < pb->pid;
+}
+
+static void edf_init(int num_cpus) {
+	pheap_init(&edf_queue, edf_less);
+	pthread_mutex_init(&edf_lock, NULL);
+	atomic_init(&nr_edf, 0);
+	nr_edf_dispatches = 0;
+	mlq_sched_class.init(num_cpus);
+}
+
+static void edf_finish(void) {
+	mlq_sched_class.finish();
+	pthread_mutex_destroy(&edf_lock);
+}
+
+static struct pcb_t * edf_get(int cpu) {
+	struct pheap_node * node = NULL;
+	if (atomic_load(&nr_edf) > 0) {
+		sched_lock(&edf_lock, cpu);
+		node = pheap_pop(&edf_queue);
+		if (node != NULL) {
+			atomic_fetch_sub(&nr_edf, 1);
+			nr_edf_dispatches++;
+		}
+		pthread_mutex_unlock(&edf_lock);
+	}
+	if (node == NULL)
+		return mlq_sched_class.get(cpu);
+	return container_of(node, struct pcb_t, run_node);
+}
+
+static void edf_enqueue(int cpu, struct pcb_t * proc) {
+	sched_lock(&edf_lock, cpu);
+	pheap_insert(&edf_queue, &proc->run_node);
+	atomic_fetch_add(&nr_edf, 1);
+	pthread_mutex_unlock(&edf_lock);
+}
+
+static void edf_put(int cpu, struct pcb_t * proc) {
+	if (proc->deadline > 0) {
+		edf_enqueue(cpu, proc);
+	}else{
+		mlq_sched_class.put(cpu, proc);
+	}
+}
+
+static void edf_add(struct pcb_t * proc) {
+	if (proc->deadline > 0) {
+		edf_enqueue(-1, proc);
+	}else{
+		mlq_sched_class.add(proc);
+	}
+}
+
+static void edf_stats(void) {
+	printf("EDF: %lu dispatches of processes with a deadline\n",
+		nr_edf_dispatches);
+}
+
+struct sched_class edf_sched_class = {
+	.name = "edf",
+	.init = edf_init,
+	.finish = edf_finish,
+	.add = edf_add,
+	.put = edf_put,
+	.get = edf_get,
+	.stats = edf_stats,
+};
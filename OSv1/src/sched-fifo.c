@@ -0,0 +1,46 @@
+
+#include "queue.h"
+#include "sched-class.h"
+#include <pthread.h>
+
+/* First come, first served: one ready queue for every CPU, preempted
+ * processes go to its tail */
+static struct queue_t ready_queue;
+static pthread_mutex_t queue_lock;
+
+static void fifo_init(int num_cpus) {
+	pthread_mutex_init(&queue_lock, NULL);
+}
+
+static void fifo_finish(void) {
+	free_queue(&ready_queue);
+	pthread_mutex_destroy(&queue_lock);
+}
+
+static struct pcb_t * fifo_get(int cpu) {
+	struct pcb_t * proc = NULL;
+	sched_lock(&queue_lock, cpu);
+	proc = dequeue(&ready_queue);
+	pthread_mutex_unlock(&queue_lock);
+	return proc;
+}
+
+static void fifo_put(int cpu, struct pcb_t * proc) {
+	sched_lock(&queue_lock, cpu);
+	enqueue(&ready_queue, proc);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+static void fifo_add(struct pcb_t * proc) {
+	fifo_put(-1, proc);
+}
+
+struct sched_class fifo_sched_class = {
+	.name = "fifo",
+	.init = fifo_init,
+	.finish = fifo_finish,
+	.add = fifo_add,
+	.put = fifo_put,
+	.get = fifo_get,
+};
+
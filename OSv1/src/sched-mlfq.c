@@ -0,0 +1,123 @@
+
+#include "queue.h"
+#include "sched-class.h"
+#include "bitops.h"
+#include "timer.h"
+#include <pthread.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+/* Multi-level feedback queue: a process starts at the top level and
+ * drops one level every time it uses up a whole quantum. A process
+ * preempted or handed back by an unplugged CPU keeps its level. A memory
+ * operation ends the CPU burst of a process the way I/O would, so
+ * processes which mostly touch memory stay on top. Every
+ * MLFQ_BOOST_PERIOD slots every waiting process goes back to the top so
+ * that CPU hogs do not starve */
+#define MLFQ_LEVELS		4
+#define MLFQ_BOOST_PERIOD	50
+
+static struct queue_t mlfq_queue[MLFQ_LEVELS];
+/* Bit [level] is set iff mlfq_queue[level] is not empty */
+static unsigned long long mlfq_bitmap[BITS_TO_ULLS(MLFQ_LEVELS)];
+static pthread_mutex_t mlfq_lock;
+static uint64_t next_boost;
+static unsigned long nr_demotions, nr_boosts;
+static atomic_ulong nr_yields;	// Counted outside of the lock
+
+static void mlfq_enqueue(struct pcb_t * proc) {
+	enqueue(&mlfq_queue[proc->level], proc);
+	set_bit_ull(proc->level, mlfq_bitmap);
+}
+
+static void mlfq_init(int num_cpus) {
+	pthread_mutex_init(&mlfq_lock, NULL);
+	next_boost = MLFQ_BOOST_PERIOD;
+}
+
+static void mlfq_finish(void) {
+	int i;
+	for (i = 0; i < MLFQ_LEVELS; i++)
+		free_queue(&mlfq_queue[i]);
+	mlfq_bitmap[0] = 0;
+	pthread_mutex_destroy(&mlfq_lock);
+}
+
+/* Move every waiting process to the top level, keeping their order */
+static void mlfq_boost(void) {
+	int i;
+	for (i = 1; i < MLFQ_LEVELS; i++) {
+		struct pcb_t * proc;
+		while ((proc = dequeue(&mlfq_queue[i])) != NULL) {
+			proc->level = 0;
+			mlfq_enqueue(proc);
+		}
+		clear_bit_ull(i, mlfq_bitmap);
+	}
+	nr_boosts++;
+}
+
+static struct pcb_t * mlfq_get(int cpu) {
+	struct pcb_t * proc = NULL;
+	int level;
+	sched_lock(&mlfq_lock, cpu);
+	if (current_time() >= next_boost) {
+		mlfq_boost();
+		next_boost = current_time() + MLFQ_BOOST_PERIOD;
+	}
+	level = find_first_bit_ull(mlfq_bitmap, MLFQ_LEVELS);
+	if (level < MLFQ_LEVELS) {
+		proc = dequeue(&mlfq_queue[level]);
+		if (empty(&mlfq_queue[level]))
+			clear_bit_ull(level, mlfq_bitmap);
+	}
+	pthread_mutex_unlock(&mlfq_lock);
+	return proc;
+}
+
+static void mlfq_put(int cpu, struct pcb_t * proc) {
+	sched_lock(&mlfq_lock, cpu);
+	if (proc->yielded) {
+		proc->yielded = 0;
+	}else if (proc->expired && proc->level < MLFQ_LEVELS - 1) {
+		proc->level++;
+		nr_demotions++;
+	}
+	mlfq_enqueue(proc);
+	pthread_mutex_unlock(&mlfq_lock);
+}
+
+static void mlfq_add(struct pcb_t * proc) {
+	sched_lock(&mlfq_lock, -1);
+	proc->level = 0;
+	proc->yielded = 0;
+	mlfq_enqueue(proc);
+	pthread_mutex_unlock(&mlfq_lock);
+}
+
+/* A step runs at most one memory operation, as its first instruction */
+static int mlfq_tick(int cpu, struct pcb_t * proc, int nr_slots) {
+	if (proc->code->text[proc->pc - nr_slots].opcode == CALC)
+		return 0;
+	proc->yielded = 1;
+	atomic_fetch_add_explicit(&nr_yields, 1, memory_order_relaxed);
+	return 1;
+}
+
+static void mlfq_stats(void) {
+	printf("MLFQ: %lu demotions, %lu yields on memory operations, "
+		"%lu boosts\n", nr_demotions, atomic_load(&nr_yields), nr_boosts);
+}
+
+struct sched_class mlfq_sched_class = {
+	.name = "mlfq",
+	.init = mlfq_init,
+	.finish = mlfq_finish,
+	.add = mlfq_add,
+	.put = mlfq_put,
+	.get = mlfq_get,
+	.tick = mlfq_tick,
+	.stats = mlfq_stats,
+};
+
@@ -0,0 +1,265 @@
+
+#include "queue.h"
+#include "sched-class.h"
+#include "bitops.h"
+#include <pthread.h>
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/* A multi-level queue with its dispatch state */
+struct mlq_t {
+	struct queue_t ready_queue[MAX_PRIO];
+	int curr_queue;
+	int32_t slot[MAX_PRIO];
+	/* Bit [prio] is set iff ready_queue[prio] is not empty */
+	unsigned long long bitmap[BITS_TO_ULLS(MAX_PRIO)];
+};
+
+static void mlq_init(struct mlq_t * q) {
+	int i;
+	q->curr_queue = 0;
+	for (i = 0; i < MAX_PRIO; i ++){
+		q->slot[i] = MAX_PRIO - i; //Init slot for each queue in ready_queue
+	}
+}
+
+static void mlq_free(struct mlq_t * q) {
+	int i;
+	for (i = 0; i < MAX_PRIO; i++)
+		free_queue(&q->ready_queue[i]);
+	for (i = 0; i < BITS_TO_ULLS(MAX_PRIO); i++)
+		q->bitmap[i] = 0;
+}
+
+static void mlq_enqueue(struct mlq_t * q, int prio, struct pcb_t * proc) {
+	enqueue(&q->ready_queue[prio], proc);
+	set_bit_ull(prio, q->bitmap);
+}
+
+static struct pcb_t * mlq_dequeue(struct mlq_t * q, int prio) {
+	struct pcb_t * proc = dequeue(&q->ready_queue[prio]);
+	if (empty(&q->ready_queue[prio]))
+		clear_bit_ull(prio, q->bitmap);
+	return proc;
+}
+
+/* The queue to dispatch from on CPU [cpu] in place of [prio]: the first
+ * queue within the affinity window whose head last ran on [cpu], or
+ * [prio] itself if there is none. Only heads are looked at so that every
+ * queue stays FIFO */
+static int mlq_affine(struct mlq_t * q, int prio, int cpu)
+{
+	struct pcb_t * head = queue_head(&q->ready_queue[prio]);
+	int i;
+	if (sched_affinity == 0 || head == NULL || head->last_cpu == cpu)
+		return prio;
+	for (i = find_next_bit_ull(q->bitmap, MAX_PRIO, prio + 1);
+			i < MAX_PRIO && i - prio <= sched_affinity;
+			i = find_next_bit_ull(q->bitmap, MAX_PRIO, i + 1)) {
+		if (queue_head(&q->ready_queue[i])->last_cpu == cpu) {
+			sched_stats[cpu].nr_affine++;
+			return i;
+		}
+	}
+	return prio;
+}
+
+/*
+ *  Stateful design for routine calling
+ *  based on the priority and our MLQ policy
+ *  We implement stateful here using transition technique
+ *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
+ */
+static struct pcb_t * mlq_get(struct mlq_t * q, int cpu)
+{
+	int curr_queue = q->curr_queue;
+	int prio = curr_queue;
+	if (empty(&q->ready_queue[curr_queue]) || q->slot[curr_queue] == 0){
+		/* First non-empty queue other than the current one */
+		int i = find_first_bit_ull(q->bitmap, MAX_PRIO);
+		if (i == curr_queue)
+			i = find_next_bit_ull(q->bitmap, MAX_PRIO, i + 1);
+		q->slot[curr_queue] = MAX_PRIO - curr_queue;
+		if (i == MAX_PRIO) {
+			if (empty(&q->ready_queue[curr_queue])) {
+				q->curr_queue = 0;
+				return NULL;
+			}
+		} else {
+			prio = i;
+			q->curr_queue = i;
+		}
+	}
+	/* An affine dispatch leaves the dispatch state alone */
+	return mlq_dequeue(q, mlq_affine(q, prio, cpu));
+}
+
+static void mlq_put(struct mlq_t * q, struct pcb_t * proc)
+{
+	q->slot[proc->prio]--;
+	mlq_enqueue(q, proc->prio, proc);
+}
+
+/* Take the process of highest priority out of [q] for another CPU,
+ * leaving the dispatch state of [q] alone */
+static struct pcb_t * mlq_steal(struct mlq_t * q)
+{
+	int i = find_first_bit_ull(q->bitmap, MAX_PRIO);
+	return i == MAX_PRIO ? NULL : mlq_dequeue(q, i);
+}
+
+/* Global MLQ: a single multi-level queue shared by every CPU */
+static struct mlq_t mlq;
+static pthread_mutex_t queue_lock;
+
+static void mlq_global_init(int num_cpus) {
+	mlq_init(&mlq);
+	pthread_mutex_init(&queue_lock, NULL);
+}
+
+static void mlq_global_finish(void) {
+	mlq_free(&mlq);
+	pthread_mutex_destroy(&queue_lock);
+}
+
+static struct pcb_t * get_mlq_proc(int cpu)
+{
+	struct pcb_t * proc = NULL;
+	sched_lock(&queue_lock, cpu);
+	proc = mlq_get(&mlq, cpu);
+	pthread_mutex_unlock(&queue_lock);
+	return proc;
+}
+
+static void put_mlq_proc(int cpu, struct pcb_t * proc)
+{
+	sched_lock(&queue_lock, cpu);
+	mlq_put(&mlq, proc);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+static void add_mlq_proc(struct pcb_t * proc)
+{
+	sched_lock(&queue_lock, -1);
+	mlq_enqueue(&mlq, proc->prio, proc);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+struct sched_class mlq_sched_class = {
+	.name = "mlq",
+	.init = mlq_global_init,
+	.finish = mlq_global_finish,
+	.add = add_mlq_proc,
+	.put = put_mlq_proc,
+	.get = get_mlq_proc,
+};
+
+/* Per-CPU MLQ: every CPU dispatches from an MLQ of its own and steals
+ * from the busiest peer once it runs dry */
+struct cpu_rq {
+	pthread_mutex_t lock;
+	struct mlq_t mlq;
+	atomic_int nr_procs;	// Processes in [mlq], read without the lock
+};
+
+static int nr_rqs = 0;
+static struct cpu_rq * rqs;
+
+static void mlq_percpu_init(int num_cpus) {
+	int i;
+	nr_rqs = num_cpus;
+	rqs = (struct cpu_rq *)calloc(num_cpus, sizeof(struct cpu_rq));
+	for (i = 0; i < num_cpus; i++) {
+		pthread_mutex_init(&rqs[i].lock, NULL);
+		mlq_init(&rqs[i].mlq);
+		atomic_init(&rqs[i].nr_procs, 0);
+	}
+}
+
+static void mlq_percpu_finish(void) {
+	int i;
+	for (i = 0; i < nr_rqs; i++) {
+		mlq_free(&rqs[i].mlq);
+		pthread_mutex_destroy(&rqs[i].lock);
+	}
+	free(rqs);
+	rqs = NULL;
+}
+
+/* The CPU other than [cpu] with the most queued processes, -1 if every
+ * other queue is empty */
+static int busiest_peer(int cpu) {
+	int i, victim = -1, most = 0;
+	for (i = 0; i < nr_rqs; i++) {
+		int n = atomic_load_explicit(&rqs[i].nr_procs,
+			memory_order_relaxed);
+		if (i != cpu && n > most) {
+			most = n;
+			victim = i;
+		}
+	}
+	return victim;
+}
+
+static struct pcb_t * get_percpu_proc(int cpu)
+{
+	struct cpu_rq * rq = &rqs[cpu];
+	struct pcb_t * proc = NULL;
+	if (atomic_load_explicit(&rq->nr_procs, memory_order_relaxed) > 0) {
+		sched_lock(&rq->lock, cpu);
+		proc = mlq_get(&rq->mlq, cpu);
+		if (proc != NULL)
+			atomic_fetch_sub(&rq->nr_procs, 1);
+		pthread_mutex_unlock(&rq->lock);
+	}
+	while (proc == NULL) {
+		/* Out of work, steal from the busiest peer. It may run dry
+		 * before we get its lock, then look again */
+		int victim = busiest_peer(cpu);
+		if (victim < 0)
+			break;
+		sched_lock(&rqs[victim].lock, cpu);
+		proc = mlq_steal(&rqs[victim].mlq);
+		if (proc != NULL)
+			atomic_fetch_sub(&rqs[victim].nr_procs, 1);
+		pthread_mutex_unlock(&rqs[victim].lock);
+		if (proc != NULL)
+			sched_stats[cpu].nr_steals++;
+	}
+	return proc;
+}
+
+/* A preempted process stays on the CPU it ran on */
+static void put_percpu_proc(int cpu, struct pcb_t * proc)
+{
+	struct cpu_rq * rq = &rqs[cpu];
+	sched_lock(&rq->lock, cpu);
+	mlq_put(&rq->mlq, proc);
+	atomic_fetch_add(&rq->nr_procs, 1);
+	pthread_mutex_unlock(&rq->lock);
+}
+
+/* A new process goes to the least loaded CPU */
+static void add_percpu_proc(struct pcb_t * proc)
+{
+	int i, cpu = 0;
+	for (i = 1; i < nr_rqs; i++) {
+		if (atomic_load(&rqs[i].nr_procs) < atomic_load(&rqs[cpu].nr_procs))
+			cpu = i;
+	}
+	sched_lock(&rqs[cpu].lock, -1);
+	mlq_enqueue(&rqs[cpu].mlq, proc->prio, proc);
+	atomic_fetch_add(&rqs[cpu].nr_procs, 1);
+	pthread_mutex_unlock(&rqs[cpu].lock);
+}
+
+struct sched_class mlq_percpu_sched_class = {
+	.name = "mlq-percpu",
+	.init = mlq_percpu_init,
+	.finish = mlq_percpu_finish,
+	.add = add_percpu_proc,
+	.put = put_percpu_proc,
+	.get = get_percpu_proc,
+};
+
@@ -0,0 +1,351 @@
+
+#include "sched-class.h"
+#include <pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Proportional share: every process holds tickets, 1 for the lowest
+ * priority up to MAX_PRIO for the highest, and gets the CPUs in
+ * proportion to them. Stride scheduling does it deterministically,
+ * lottery scheduling at random */
+static int share_tickets(struct pcb_t * proc) {
+	return MAX_PRIO - proc->prio;
+}
+
+/* Accounting of the share of every process. While a process is ready or
+ * running, every CPU slot handed out entitles each of its tickets to
+ * 1 / [nr_tickets] of the slot, [entitled] sums these. A process is
+ * entitled to its tickets times the growth of [entitled] over its
+ * lifetime but the time it was blocked, out of the growth of
+ * [nr_slots] */
+static uint64_t nr_tickets;	// Tickets of the ready and running processes
+static double entitled;		// Slots entitled per ticket so far
+static uint64_t nr_slots;	// Slots handed out so far
+static pthread_mutex_t share_lock;
+
+struct share_record {
+	uint32_t pid;
+	uint32_t tickets;
+	double target;		// Share the tickets entitle the process to
+	double achieved;	// Share of the slots the process has got
+};
+
+static struct share_record * share_records;
+static int nr_share_records;
+
+static void share_init(void) {
+	pthread_mutex_init(&share_lock, NULL);
+	nr_tickets = 0;
+	entitled = 0;
+	nr_slots = 0;
+	share_records = NULL;
+	nr_share_records = 0;
+}
+
+static void share_finish(void) {
+	pthread_mutex_destroy(&share_lock);
+	free(share_records);
+	share_records = NULL;
+}
+
+/* [proc] is new: it takes part from now on. Called with share_lock held */
+static void share_join(struct pcb_t * proc) {
+	proc->tickets = share_tickets(proc);
+	proc->share_start = entitled;
+	proc->work_start = nr_slots;
+	nr_tickets += proc->tickets;
+}
+
+/* [proc] blocks: its tickets leave until share_wake */
+static void share_block(int cpu, struct pcb_t * proc) {
+	sched_lock(&share_lock, cpu);
+	proc->share_blocked = entitled;
+	nr_tickets -= proc->tickets;
+	pthread_mutex_unlock(&share_lock);
+}
+
+/* [proc] is woken: the growth of [entitled] while it was blocked is not
+ * its own. Called with share_lock held */
+static void share_wake(struct pcb_t * proc) {
+	proc->share_start += entitled - proc->share_blocked;
+	nr_tickets += proc->tickets;
+}
+
+/* The slots of a process which has just blocked may come after the last
+ * tickets have left */
+static void share_tick(int nr) {
+	pthread_mutex_lock(&share_lock);
+	if (nr_tickets > 0)
+		entitled += (double)nr / nr_tickets;
+	nr_slots += nr;
+	pthread_mutex_unlock(&share_lock);
+}
+
+static void share_exit(int cpu, struct pcb_t * proc) {
+	struct share_record * r;
+	uint64_t work;
+	pthread_mutex_lock(&share_lock);
+	work = nr_slots - proc->work_start;
+	if ((nr_share_records & (nr_share_records - 1)) == 0) {
+		/* Grow at every power of two */
+		share_records = (struct share_record *)realloc(share_records,
+			sizeof(struct share_record)
+			* (nr_share_records ? nr_share_records * 2 : 1));
+	}
+	r = &share_records[nr_share_records++];
+	r->pid = proc->pid;
+	r->tickets = proc->tickets;
+	r->target = work > 0
+		? proc->tickets * (entitled - proc->share_start) / work : 0.0;
+	r->achieved = work > 0 ? (double)proc->run_time / work : 0.0;
+	nr_tickets -= proc->tickets;
+	pthread_mutex_unlock(&share_lock);
+}
+
+/* Achieved against target share of every process, then the mean error */
+static void share_stats(void) {
+	double error = 0;
+	int i;
+	for (i = 0; i < nr_share_records; i++) {
+		struct share_record * r = &share_records[i];
+		printf("PID %3u: %3u tickets, target share %5.1f%%, "
+			"achieved %5.1f%%\n", r->pid, r->tickets,
+			100.0 * r->target, 100.0 * r->achieved);
+		error += r->achieved > r->target
+			? r->achieved - r->target : r->target - r->achieved;
+	}
+	if (nr_share_records > 0) {
+		printf("Share error: %.2f%% on average\n",
+			100.0 * error / nr_share_records);
+	}
+}
+
+/* Stride scheduling: a process advances its pass by its stride, inversely
+ * proportional to its tickets, for every slot it runs. The ready process
+ * with the lowest pass runs next, from a pairing heap */
+#define STRIDE1		(1 << 20)
+
+static struct pheap stride_queue;
+static uint64_t min_pass;	// Pass of the last dispatch
+
+static uint64_t stride_of(struct pcb_t * proc) {
+	return STRIDE1 / proc->tickets;
+}
+
+static int stride_less(struct pheap_node * a, struct pheap_node * b) {
+	struct pcb_t * pa = container_of(a, struct pcb_t, run_node);
+	struct pcb_t * pb = container_of(b, struct pcb_t, run_node);
+	if (pa->pass != pb->pass)
+		return pa->pass < pb->pass;
+	return pa->pid < pb->pid;
+}
+
+static void stride_init(int num_cpus) {
+	share_init();
+	pheap_init(&stride_queue, stride_less);
+	min_pass = 0;
+}
+
+static struct pcb_t * stride_get(int cpu) {
+	struct pheap_node * node;
+	struct pcb_t * proc = NULL;
+	sched_lock(&share_lock, cpu);
+	node = pheap_pop(&stride_queue);
+	if (node != NULL) {
+		proc = container_of(node, struct pcb_t, run_node);
+		if (proc->pass > min_pass)
+			min_pass = proc->pass;
+	}
+	pthread_mutex_unlock(&share_lock);
+	return proc;
+}
+
+static void stride_put(int cpu, struct pcb_t * proc) {
+	sched_lock(&share_lock, cpu);
+	pheap_insert(&stride_queue, &proc->run_node);
+	pthread_mutex_unlock(&share_lock);
+}
+
+/* A woken process catches up to the last dispatch, so that it cannot
+ * claim the time it was blocked for */
+static void stride_wake(int cpu, struct pcb_t * proc) {
+	sched_lock(&share_lock, cpu);
+	share_wake(proc);
+	if (proc->pass < min_pass)
+		proc->pass = min_pass;
+	pheap_insert(&stride_queue, &proc->run_node);
+	pthread_mutex_unlock(&share_lock);
+}
+
+/* A new process starts one stride after the others, as if it had just
+ * run, so that it cannot claim the time it was not there for */
+static void stride_add(struct pcb_t * proc) {
+	sched_lock(&share_lock, -1);
+	share_join(proc);
+	proc->pass = min_pass + stride_of(proc);
+	pheap_insert(&stride_queue, &proc->run_node);
+	pthread_mutex_unlock(&share_lock);
+}
+
+/* [proc] is off the heap while it runs, so its pass needs no lock */
+static int stride_tick(int cpu, struct pcb_t * proc, int nr) {
+	proc->pass += stride_of(proc) * nr;
+	share_tick(nr);
+	return 0;
+}
+
+struct sched_class stride_sched_class = {
+	.name = "stride",
+	.init = stride_init,
+	.finish = share_finish,
+	.add = stride_add,
+	.put = stride_put,
+	.block = share_block,
+	.wake = stride_wake,
+	.get = stride_get,
+	.tick = stride_tick,
+	.exit = share_exit,
+	.stats = share_stats,
+};
+
+/* Lottery scheduling: the next process is drawn at random with odds in
+ * proportion to its tickets. The ready processes are the leaves of a
+ * sum tree, where every node holds the tickets below it, so both a draw
+ * and an update walk a single path of O(log n) nodes */
+#define LOTTERY_SEED	0x2545F4914F6CDD1DULL
+
+static uint64_t * lottery_sum;		// Nodes 1 .. 2 * cap - 1, 1 is the root
+static struct pcb_t ** lottery_leaf;	// Process at every leaf
+static int lottery_cap;			// Number of leaves, a power of two
+static int * lottery_free;		// Stack of free leaves
+static int nr_lottery_free;
+static uint64_t lottery_rng;
+
+/* xorshift64* */
+static uint64_t lottery_rand(void) {
+	lottery_rng ^= lottery_rng >> 12;
+	lottery_rng ^= lottery_rng << 25;
+	lottery_rng ^= lottery_rng >> 27;
+	return lottery_rng * 0x2545F4914F6CDD1DULL;
+}
+
+/* Give leaf [leaf] [tickets] tickets */
+static void lottery_set(int leaf, uint64_t tickets) {
+	int i = lottery_cap + leaf;
+	lottery_sum[i] = tickets;
+	for (i >>= 1; i > 0; i >>= 1)
+		lottery_sum[i] = lottery_sum[2 * i] + lottery_sum[2 * i + 1];
+}
+
+/* Double the number of leaves. The old tree becomes the left half */
+static void lottery_grow(void) {
+	int cap = lottery_cap == 0 ? 16 : lottery_cap * 2;
+	uint64_t * sum = (uint64_t *)calloc(2 * cap, sizeof(uint64_t));
+	int i;
+	lottery_leaf = (struct pcb_t **)realloc(lottery_leaf,
+		sizeof(struct pcb_t *) * cap);
+	lottery_free = (int *)realloc(lottery_free, sizeof(int) * cap);
+	for (i = 0; i < lottery_cap; i++)
+		sum[cap + i] = lottery_sum[lottery_cap + i];
+	for (i = cap - 1; i > 0; i--)
+		sum[i] = sum[2 * i] + sum[2 * i + 1];
+	/* Free leaves are taken from the top of the stack, lowest first */
+	for (i = cap - 1; i >= lottery_cap; i--)
+		lottery_free[nr_lottery_free++] = i;
+	free(lottery_sum);
+	lottery_sum = sum;
+	lottery_cap = cap;
+}
+
+static void lottery_init(int num_cpus) {
+	share_init();
+	lottery_sum = NULL;
+	lottery_leaf = NULL;
+	lottery_free = NULL;
+	lottery_cap = 0;
+	nr_lottery_free = 0;
+	lottery_rng = LOTTERY_SEED;
+	lottery_grow();
+}
+
+static void lottery_finish(void) {
+	share_finish();
+	free(lottery_sum);
+	free(lottery_leaf);
+	free(lottery_free);
+	lottery_sum = NULL;
+	lottery_leaf = NULL;
+	lottery_free = NULL;
+}
+
+/* Called with share_lock held */
+static void lottery_enqueue(struct pcb_t * proc) {
+	int leaf;
+	if (nr_lottery_free == 0)
+		lottery_grow();
+	leaf = lottery_free[--nr_lottery_free];
+	lottery_leaf[leaf] = proc;
+	lottery_set(leaf, proc->tickets);
+}
+
+static struct pcb_t * lottery_get(int cpu) {
+	struct pcb_t * proc = NULL;
+	sched_lock(&share_lock, cpu);
+	if (lottery_sum[1] > 0) {
+		uint64_t ticket = lottery_rand() % lottery_sum[1];
+		int i = 1;
+		while (i < lottery_cap) {
+			if (ticket < lottery_sum[2 * i]) {
+				i = 2 * i;
+			}else{
+				ticket -= lottery_sum[2 * i];
+				i = 2 * i + 1;
+			}
+		}
+		proc = lottery_leaf[i - lottery_cap];
+		lottery_set(i - lottery_cap, 0);
+		lottery_free[nr_lottery_free++] = i - lottery_cap;
+	}
+	pthread_mutex_unlock(&share_lock);
+	return proc;
+}
+
+static void lottery_put(int cpu, struct pcb_t * proc) {
+	sched_lock(&share_lock, cpu);
+	lottery_enqueue(proc);
+	pthread_mutex_unlock(&share_lock);
+}
+
+static void lottery_wake(int cpu, struct pcb_t * proc) {
+	sched_lock(&share_lock, cpu);
+	share_wake(proc);
+	lottery_enqueue(proc);
+	pthread_mutex_unlock(&share_lock);
+}
+
+static void lottery_add(struct pcb_t * proc) {
+	sched_lock(&share_lock, -1);
+	share_join(proc);
+	lottery_enqueue(proc);
+	pthread_mutex_unlock(&share_lock);
+}
+
+static int lottery_tick(int cpu, struct pcb_t * proc, int nr) {
+	share_tick(nr);
+	return 0;
+}
+
+struct sched_class lottery_sched_class = {
+	.name = "lottery",
+	.init = lottery_init,
+	.finish = lottery_finish,
+	.add = lottery_add,
+	.put = lottery_put,
+	.block = share_block,
+	.wake = lottery_wake,
+	.get = lottery_get,
+	.tick = lottery_tick,
+	.exit = share_exit,
+	.stats = share_stats,
+};
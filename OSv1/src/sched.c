@@ -1,133 +1,660 @@
 
+#include "sched-class.h"
 #include "queue.h"
-#include "sched.h"
+#include "timer.h"
 #include <pthread.h>
 
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
-static struct queue_t ready_queue;
-static struct queue_t run_queue;
-static pthread_mutex_t queue_lock;
-
-#ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
-int curr_slot;
-int curr_queue;
-static int32_t slot[MAX_PRIO];
-#endif
-
-int queue_empty(void) {
-#ifdef MLQ_SCHED
-	unsigned long prio;
-	for (prio = 0; prio < MAX_PRIO; prio++)
-		if(!empty(&mlq_ready_queue[prio])) 
-			return -1;
-#endif
-	return (empty(&ready_queue) && empty(&run_queue));
-}
-
-void init_scheduler(void) {
-#ifdef MLQ_SCHED
-	int i ;
-	curr_slot = MAX_PRIO;
-	curr_queue = 0;
-	for (i = 0; i < MAX_PRIO; i ++){
-		mlq_ready_queue[i].size = 0;
-		slot[i] = MAX_PRIO - i; //Init slot for each queue in ready_queue
-	}
-		
-#endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
-	pthread_mutex_init(&queue_lock, NULL);
-}
-
-#ifdef MLQ_SCHED
-/* 
- *  Stateful design for routine calling
- *  based on the priority and our MLQ policy
- *  We implement stateful here using transition technique
- *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
- */
-struct pcb_t * get_mlq_proc(void) 
-{
-	struct pcb_t * proc = NULL;
-	pthread_mutex_lock(&queue_lock);
-	if (empty(&mlq_ready_queue[curr_queue]) || slot[curr_queue] == 0){
-		int i;
-		for (i = 0; i < MAX_PRIO; i++) {
-			if (i == curr_queue)
+#include <string.h>
+#include <time.h>
+
+/* Every policy, the first one is the default */
+static struct sched_class * sched_classes[] = {
+	&mlq_sched_class,
+	&mlq_percpu_sched_class,
+	&fifo_sched_class,
+	&cfs_sched_class,
+	&mlfq_sched_class,
+	&edf_sched_class,
+	&stride_sched_class,
+	&lottery_sched_class,
+};
+
+#define NR_SCHED_CLASSES \
+	(int)(sizeof(sched_classes) / sizeof(sched_classes[0]))
+
+static struct sched_class * sched = NULL;
+static int sched_cpus = 0;
+struct sched_stat * sched_stats;
+int sched_affinity = 0;
+
+/* Accounting of a finished process */
+struct proc_record {
+	uint32_t pid;
+	uint32_t prio;
+	uint64_t arrival;
+	uint64_t first_dispatch;
+	uint64_t finish;
+	uint64_t turnaround;	// From arrival to finish
+	uint64_t run_time;
+	uint64_t wait_time;
+	uint64_t block_time;
+	uint64_t response_time;	// From arrival to first dispatch
+	uint64_t nr_switches;
+	uint64_t nr_migrations;
+	uint64_t deadline;	// 0 if none
+};
+
+static struct proc_record * records;
+static int nr_records = 0;
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A lock or a semaphore. Lock values are 1 when free and 0 when held */
+struct sync_obj {
+	int used;
+	int value;
+	uint32_t owner;			// Lock: PID of the holder
+	struct queue_t waiters;		// Blocked processes, in FIFO order
+	unsigned long nr_acquires;	// Takes, at once or after waiting
+	unsigned long nr_contended;	// ... which had to wait
+	uint64_t wait_slots;		// Slots spent in [waiters]
+	uint64_t max_wait;
+};
+
+/* Objects of a type, indexed by ID. Grown on first use of an ID */
+struct sync_table {
+	const char * name;
+	int init_value;
+	struct sync_obj * obj;
+	uint32_t nr_obj;
+};
+
+static struct sync_table sync_tables[] = {
+	[SYNC_LOCK] = { "Lock", 1, NULL, 0 },
+	[SYNC_SEM] = { "Semaphore", 0, NULL, 0 },
+};
+
+#define NR_SYNC_TYPES \
+	(int)(sizeof(sync_tables) / sizeof(sync_tables[0]))
+
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int nr_live;	// Processes added and not finished yet
+static atomic_int nr_blocked;	// ... which wait on a kernel object
+
+/* A simulated device. The request in service completes with a timer
+ * callback, which starts the next one */
+struct io_dev {
+	int used;
+	struct pcb_t * active;		// Process of the request in service
+	struct queue_t waiters;		// Processes of the queued requests
+	unsigned long nr_requests;
+	uint64_t busy_slots;		// Slots spent serving requests
+	uint64_t queue_slots;		// Slots requests waited in [waiters]
+};
+
+static struct io_dev io_devs[MAX_IO_DEV];
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int nr_io;	// Processes waiting on a device
+static atomic_ulong io_overlap;	// Slots run on CPUs while I/O was in flight
+static atomic_int nr_sleeping;	// Processes in a SLEEP
+static atomic_ulong nr_sleeps;
+static void (*ready_notify)(int cpu);
+static int sched_timed = 0;	// Time get_proc, set with sched_account
+
+static unsigned long elapsed_ns(struct timespec * from) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - from->tv_sec) * 1000000000UL
+		+ now.tv_nsec - from->tv_nsec;
+}
+
+void sched_lock(pthread_mutex_t * lock, int cpu) {
+	struct timespec start;
+	if (pthread_mutex_trylock(lock) == 0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_mutex_lock(lock);
+	if (cpu >= 0) {
+		sched_stats[cpu].nr_lock_waits++;
+		sched_stats[cpu].lock_wait_ns += elapsed_ns(&start);
+	}
+}
+
+int set_scheduler(const char * name) {
+	int i;
+	for (i = 0; i < NR_SCHED_CLASSES; i++) {
+		if (!strcmp(sched_classes[i]->name, name)) {
+			sched = sched_classes[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void set_affinity(int window) {
+	sched_affinity = window;
+}
+
+void init_scheduler(int num_cpus) {
+	if (sched == NULL)
+		sched = sched_classes[0];
+	sched_cpus = num_cpus;
+	sched_stats = (struct sched_stat *)
+		calloc(num_cpus, sizeof(struct sched_stat));
+	if (sched->init != NULL)
+		sched->init(num_cpus);
+}
+
+void finish_scheduler(void) {
+	int i;
+	if (sched->finish != NULL)
+		sched->finish();
+	free(sched_stats);
+	sched_stats = NULL;
+	free(records);
+	records = NULL;
+	nr_records = 0;
+	for (i = 0; i < NR_SYNC_TYPES; i++) {
+		struct sync_table * t = &sync_tables[i];
+		uint32_t id;
+		for (id = 0; id < t->nr_obj; id++)
+			free_queue(&t->obj[id].waiters);
+		free(t->obj);
+		t->obj = NULL;
+		t->nr_obj = 0;
+	}
+	for (i = 0; i < MAX_IO_DEV; i++)
+		free_queue(&io_devs[i].waiters);
+}
+
+static int cmp_u64(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile [p] of the [n] sorted values [v] */
+static uint64_t percentile(uint64_t * v, int n, int p) {
+	int rank = (p * n + 99) / 100;
+	return v[rank > 0 ? rank - 1 : 0];
+}
+
+/* Sort the [n] values [v] and print their percentiles, counted in
+ * [unit] */
+static void print_sorted(const char * name, uint64_t * v, int n,
+		const char * unit) {
+	qsort(v, n, sizeof(uint64_t), cmp_u64);
+	printf("%s: p50 %lu, p95 %lu, p99 %lu, max %lu %s\n", name,
+		percentile(v, n, 50), percentile(v, n, 95),
+		percentile(v, n, 99), v[n - 1], unit);
+}
+
+/* Print percentiles of the field at [offset] of every record, counted
+ * in [unit] */
+static void print_percentiles(const char * name, size_t offset,
+		const char * unit) {
+	uint64_t * v = (uint64_t *)malloc(sizeof(uint64_t) * nr_records);
+	int i;
+	for (i = 0; i < nr_records; i++)
+		v[i] = *(uint64_t *)((char *)&records[i] + offset);
+	print_sorted(name, v, nr_records, unit);
+	free(v);
+}
+
+/* Deadline misses and lateness (slots past the deadline, 0 if it was
+ * met) of the processes with a deadline */
+static void print_deadline_stat(void) {
+	uint64_t * lateness = (uint64_t *)malloc(sizeof(uint64_t) * nr_records);
+	int i, n = 0, nr_missed = 0;
+	for (i = 0; i < nr_records; i++) {
+		struct proc_record * r = &records[i];
+		if (r->deadline == 0)
+			continue;
+		lateness[n] = r->finish > r->deadline ? r->finish - r->deadline : 0;
+		if (lateness[n] > 0)
+			nr_missed++;
+		n++;
+	}
+	if (n > 0) {
+		printf("Deadlines: %d of %d missed\n", nr_missed, n);
+		print_sorted("Lateness", lateness, n, "slots");
+	}
+	free(lateness);
+}
+
+#define PRINT_PERCENTILES(name, field, unit) \
+	print_percentiles(name, offsetof(struct proc_record, field), unit)
+
+/* Timestamps, times and counters of every process and their share of
+ * CPU over its lifetime, then the percentiles over the whole workload
+ * and Jain's fairness index of the shares */
+static void print_proc_stat(void) {
+	double sum = 0, sum_sq = 0;
+	int i;
+	if (nr_records == 0)
+		return;
+	for (i = 0; i < nr_records; i++) {
+		struct proc_record * r = &records[i];
+		double share = r->turnaround > 0
+			? (double)r->run_time / r->turnaround : 1.0;
+		sum += share;
+		sum_sq += share * share;
+		printf("PID %3u (prio %3u): arrival %3lu, first dispatch %3lu, "
+			"finish %3lu, run %3lu, wait %3lu, blocked %3lu, "
+			"response %3lu, %lu switches, %lu migrations, "
+			"CPU share %.2f\n",
+			r->pid, r->prio, r->arrival, r->first_dispatch, r->finish,
+			r->run_time, r->wait_time, r->block_time, r->response_time,
+			r->nr_switches, r->nr_migrations, share);
+	}
+	PRINT_PERCENTILES("Wait time", wait_time, "slots");
+	PRINT_PERCENTILES("Block time", block_time, "slots");
+	PRINT_PERCENTILES("Response time", response_time, "slots");
+	PRINT_PERCENTILES("Run time", run_time, "slots");
+	PRINT_PERCENTILES("Turnaround", turnaround, "slots");
+	PRINT_PERCENTILES("Context switches", nr_switches, "per process");
+	PRINT_PERCENTILES("Migrations", nr_migrations, "per process");
+	printf("Fairness (Jain index of CPU shares): %.3f\n",
+		sum * sum / (nr_records * sum_sq));
+	print_deadline_stat();
+}
+
+/* Acquisitions, contention and wait time of every kernel object in use,
+ * then of all of them */
+static void print_sync_stat(void) {
+	unsigned long nr_acquires = 0, nr_contended = 0;
+	uint64_t wait_slots = 0;
+	int i;
+	for (i = 0; i < NR_SYNC_TYPES; i++) {
+		struct sync_table * t = &sync_tables[i];
+		uint32_t id;
+		for (id = 0; id < t->nr_obj; id++) {
+			struct sync_obj * o = &t->obj[id];
+			if (!o->used)
 				continue;
-			proc = dequeue(&mlq_ready_queue[i]);
-			if (proc != NULL)
-				break;
+			printf("%s %3u: %lu acquisitions, %lu contended (%.1f%%), "
+				"wait %.1f slots on average, max %lu, "
+				"%d still waiting\n", t->name, id, o->nr_acquires,
+				o->nr_contended, o->nr_acquires > 0
+				? 100.0 * o->nr_contended / o->nr_acquires : 0.0,
+				o->nr_contended > 0
+				? (double)o->wait_slots / o->nr_contended : 0.0,
+				o->max_wait, o->waiters.size);
+			nr_acquires += o->nr_acquires;
+			nr_contended += o->nr_contended;
+			wait_slots += o->wait_slots;
 		}
-		slot[curr_queue] = MAX_PRIO - curr_queue;
-		if (proc == NULL) {
-			proc = dequeue(&mlq_ready_queue[curr_queue]);
-			curr_queue = proc == NULL ? 0 : curr_queue;
-		} else {
-			curr_queue = i;
+	}
+	if (nr_acquires == 0 && atomic_load(&nr_blocked) == 0)
+		return;
+	printf("Kernel objects: %lu acquisitions, %.1f%% contended, "
+		"%lu slots waited\n", nr_acquires, nr_acquires > 0
+		? 100.0 * nr_contended / nr_acquires : 0.0, wait_slots);
+	if (atomic_load(&nr_blocked) > 0) {
+		printf("Deadlock: %d processes left blocked\n",
+			atomic_load(&nr_blocked));
+	}
+}
+
+/* Requests, utilization and queueing of every device in use, then the
+ * CPU slots that overlapped with I/O out of every slot run */
+static void print_io_stat(void) {
+	uint64_t slots = current_time();
+	uint64_t run_slots = 0;
+	int i, used = 0;
+	for (i = 0; i < MAX_IO_DEV; i++) {
+		struct io_dev * d = &io_devs[i];
+		if (!d->used)
+			continue;
+		used = 1;
+		printf("Device %2d: %lu requests, busy %lu of %lu slots "
+			"(%.1f%% utilization), queued %.1f slots on average\n",
+			i, d->nr_requests, d->busy_slots, slots,
+			slots > 0 ? 100.0 * d->busy_slots / slots : 0.0,
+			d->nr_requests > 0
+			? (double)d->queue_slots / d->nr_requests : 0.0);
+	}
+	if (!used)
+		return;
+	for (i = 0; i < nr_records; i++)
+		run_slots += records[i].run_time;
+	printf("I/O overlap: %lu of %lu CPU slots ran while I/O was in "
+		"flight (%.1f%%)\n", atomic_load(&io_overlap), run_slots,
+		run_slots > 0 ? 100.0 * atomic_load(&io_overlap) / run_slots
+		: 0.0);
+}
+
+void print_sched_stat(void) {
+	struct sched_stat total = {0};
+	int i;
+	for (i = 0; i < sched_cpus; i++) {
+		struct sched_stat * s = &sched_stats[i];
+		printf("CPU %3d: %lu dispatches (%.0f ns per get_proc), "
+			"%lu steals, %lu migrations, %lu affine, "
+			"%lu lock waits (%.1f us)\n",
+			i, s->nr_dispatches,
+			s->nr_gets > 0 ? (double)s->dispatch_ns / s->nr_gets : 0.0,
+			s->nr_steals, s->nr_migrations, s->nr_affine,
+			s->nr_lock_waits, s->lock_wait_ns / 1e3);
+		total.nr_gets += s->nr_gets;
+		total.nr_dispatches += s->nr_dispatches;
+		total.dispatch_ns += s->dispatch_ns;
+		total.nr_steals += s->nr_steals;
+		total.nr_migrations += s->nr_migrations;
+		total.nr_affine += s->nr_affine;
+		total.nr_lock_waits += s->nr_lock_waits;
+		total.lock_wait_ns += s->lock_wait_ns;
+	}
+	printf("Scheduler %s: %lu dispatches (%.0f ns per get_proc), "
+		"%lu steals, %lu migrations, %lu lock waits (%.1f us)\n",
+		sched->name, total.nr_dispatches,
+		total.nr_gets > 0 ? (double)total.dispatch_ns / total.nr_gets : 0.0,
+		total.nr_steals, total.nr_migrations,
+		total.nr_lock_waits, total.lock_wait_ns / 1e3);
+	printf("Migration rate: %.1f%% of dispatches, affinity window %d "
+		"(%lu affine dispatches)\n",
+		total.nr_dispatches > 0
+			? 100.0 * total.nr_migrations / total.nr_dispatches : 0.0,
+		sched_affinity, total.nr_affine);
+	if (sched->stats != NULL)
+		sched->stats();
+	print_sync_stat();
+	print_io_stat();
+	if (atomic_load(&nr_sleeps) > 0)
+		printf("Sleeps: %lu\n", atomic_load(&nr_sleeps));
+	print_proc_stat();
+}
+
+void sched_account(int enable) {
+	sched_timed = enable;
+}
+
+struct pcb_t * get_proc(int cpu) {
+	struct timespec start;
+	struct pcb_t * proc;
+	if (sched_timed) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		proc = sched->get(cpu);
+		sched_stats[cpu].dispatch_ns += elapsed_ns(&start);
+	}else{
+		proc = sched->get(cpu);
+	}
+	sched_stats[cpu].nr_gets++;
+	if (proc != NULL) {
+		proc->wait_time += current_time() - proc->ready_since;
+		if (proc->first_dispatch == TIMER_IDLE)
+			proc->first_dispatch = current_time();
+		sched_stats[cpu].nr_dispatches++;
+		if (proc->last_cpu >= 0 && proc->last_cpu != cpu) {
+			sched_stats[cpu].nr_migrations++;
+			proc->nr_migrations++;
 		}
-	} else {
-		proc = dequeue(&mlq_ready_queue[curr_queue]);
+		proc->last_cpu = cpu;
 	}
-	pthread_mutex_unlock(&queue_lock);
 	return proc;
 }
 
-void put_mlq_proc(struct pcb_t * proc) 
-{
-	pthread_mutex_lock(&queue_lock);
-	slot[proc->prio]--;
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+void put_proc(int cpu, struct pcb_t * proc) {
+	proc->ready_since = current_time();
+	sched->put(cpu, proc);
 }
 
-void add_mlq_proc(struct pcb_t * proc) 
-{
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);	
+/* [proc] leaves the ready processes until wake_proc */
+static void block_proc(int cpu, struct pcb_t * proc) {
+	if (sched->block != NULL)
+		sched->block(cpu, proc);
 }
 
-struct pcb_t * get_proc(void) 
-{
-	return get_mlq_proc();
+/* Put [proc], which has blocked, back to the ready queue */
+static void wake_proc(int cpu, struct pcb_t * proc) {
+	proc->ready_since = current_time();
+	if (sched->wake != NULL) {
+		sched->wake(cpu, proc);
+	}else{
+		sched->put(cpu, proc);
+	}
 }
 
-void put_proc(struct pcb_t * proc) 
-{
-	return put_mlq_proc(proc);
+void add_proc(struct pcb_t * proc) {
+	proc->ready_since = current_time();
+	proc->wait_time = 0;
+	proc->run_time = 0;
+	proc->first_dispatch = TIMER_IDLE;
+	proc->nr_migrations = 0;
+	proc->block_time = 0;
+	atomic_init(&proc->leaving, 0);
+	proc->expired = 0;
+	atomic_fetch_add(&nr_live, 1);
+	sched->add(proc);
 }
 
-void add_proc(struct pcb_t * proc) 
-{
-	return add_mlq_proc(proc);
+int sched_tick(int cpu, struct pcb_t * proc, int nr_slots) {
+	proc->run_time += nr_slots;
+	if (atomic_load_explicit(&nr_io, memory_order_relaxed) > 0)
+		atomic_fetch_add(&io_overlap, nr_slots);
+	if (sched->tick == NULL)
+		return 0;
+	return sched->tick(cpu, proc, nr_slots);
 }
-#else
-struct pcb_t * get_proc(void) {
-	struct pcb_t * proc = NULL;
-	/*TODO: get a process from [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
-	pthread_mutex_lock(&queue_lock);
-	proc = dequeue(&ready_queue);
-	pthread_mutex_unlock(&queue_lock);
-	return proc;
+
+void sched_exit(int cpu, struct pcb_t * proc) {
+	struct proc_record * r;
+	if (sched->exit != NULL)
+		sched->exit(cpu, proc);
+	pthread_mutex_lock(&record_lock);
+	if ((nr_records & (nr_records - 1)) == 0) {
+		/* Grow at every power of two */
+		records = (struct proc_record *)realloc(records,
+			sizeof(struct proc_record) * (nr_records ? nr_records * 2 : 1));
+	}
+	proc->completion = current_time();
+	r = &records[nr_records++];
+	r->pid = proc->pid;
+	r->prio = proc->prio;
+	r->arrival = proc->arrival;
+	r->first_dispatch = proc->first_dispatch;
+	r->finish = proc->completion;
+	r->turnaround = proc->completion - proc->arrival;
+	r->run_time = proc->run_time;
+	r->wait_time = proc->wait_time;
+	r->block_time = proc->block_time;
+	r->response_time = proc->first_dispatch - proc->arrival;
+	r->nr_switches = proc->nr_switches;
+	r->nr_migrations = proc->nr_migrations;
+	r->deadline = proc->deadline;
+	pthread_mutex_unlock(&record_lock);
+	atomic_fetch_sub(&nr_live, 1);
 }
 
-void put_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&run_queue, proc);
-	pthread_mutex_unlock(&queue_lock);
+/* Object [id] of type [type], NULL if [id] is out of range. Called with
+ * sync_lock held */
+static struct sync_obj * sync_obj(enum sync_type type, uint32_t id) {
+	struct sync_table * t = &sync_tables[type];
+	struct sync_obj * o;
+	if (id >= MAX_SYNC_OBJ)
+		return NULL;
+	if (id >= t->nr_obj) {
+		uint32_t n = t->nr_obj > 0 ? t->nr_obj : 16;
+		while (n <= id)
+			n *= 2;
+		t->obj = (struct sync_obj *)realloc(t->obj,
+			sizeof(struct sync_obj) * n);
+		memset(&t->obj[t->nr_obj], 0,
+			sizeof(struct sync_obj) * (n - t->nr_obj));
+		t->nr_obj = n;
+	}
+	o = &t->obj[id];
+	if (!o->used) {
+		o->used = 1;
+		o->value = t->init_value;
+	}
+	return o;
 }
 
-void add_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&ready_queue, proc);
-	pthread_mutex_unlock(&queue_lock);	
+int sem_init(uint32_t id, int value) {
+	struct sync_obj * o;
+	pthread_mutex_lock(&sync_lock);
+	o = sync_obj(SYNC_SEM, id);
+	if (o != NULL)
+		o->value = value;
+	pthread_mutex_unlock(&sync_lock);
+	return o != NULL ? 0 : -1;
 }
-#endif
 
+int sync_wait(int cpu, struct pcb_t * proc, enum sync_type type, uint32_t id) {
+	struct sync_obj * o;
+	int stat = 0;
+	sched_lock(&sync_lock, cpu);
+	o = sync_obj(type, id);
+	if (o == NULL || (type == SYNC_LOCK && o->value == 0
+			&& o->owner == proc->pid)) {
+		stat = -1;
+	}else if (o->value > 0) {
+		o->value--;
+		o->owner = proc->pid;
+		o->nr_acquires++;
+	}else{
+		/* The CPU still charges the slot to [proc] after this, so
+		 * whoever releases it before the CPU lets go leaves the put
+		 * to the CPU */
+		atomic_store(&proc->leaving, 1);
+		proc->blocked_since = current_time();
+		block_proc(cpu, proc);
+		enqueue(&o->waiters, proc);
+		o->nr_contended++;
+		atomic_fetch_add(&nr_blocked, 1);
+		stat = 1;
+	}
+	pthread_mutex_unlock(&sync_lock);
+	return stat;
+}
+
+int sync_post(int cpu, struct pcb_t * proc, enum sync_type type, uint32_t id) {
+	struct sync_obj * o;
+	struct pcb_t * waiter = NULL;
+	sched_lock(&sync_lock, cpu);
+	o = sync_obj(type, id);
+	if (o == NULL || (type == SYNC_LOCK && (o->value > 0
+			|| o->owner != proc->pid))) {
+		pthread_mutex_unlock(&sync_lock);
+		return -1;
+	}
+	waiter = dequeue(&o->waiters);
+	if (waiter == NULL) {
+		o->value++;
+	}else{
+		/* Hand the object over, so that nobody can take it in
+		 * between: the value stays as it is */
+		uint64_t wait = current_time() - waiter->blocked_since;
+		o->owner = waiter->pid;
+		o->nr_acquires++;
+		o->wait_slots += wait;
+		if (wait > o->max_wait)
+			o->max_wait = wait;
+		waiter->block_time += wait;
+	}
+	pthread_mutex_unlock(&sync_lock);
+	if (waiter == NULL)
+		return 0;
+	/* If the CPU of [waiter] is still charging its slot, sched_release
+	 * puts it back instead */
+	int leaving = 1;
+	if (atomic_compare_exchange_strong(&waiter->leaving, &leaving, 2))
+		return 1;
+	wake_proc(cpu, waiter);
+	atomic_fetch_sub(&nr_blocked, 1);
+	return 1;
+}
+
+int sched_release(int cpu, struct pcb_t * proc) {
+	if (atomic_exchange(&proc->leaving, 0) != 2)
+		return 0;
+	wake_proc(cpu, proc);
+	atomic_fetch_sub(&nr_blocked, 1);
+	return 1;
+}
+
+static void io_complete(void * arg);
+
+/* Serve [proc] on [d] from now on. Called with io_lock held */
+static void io_start(struct io_dev * d, struct pcb_t * proc) {
+	uint64_t now = current_time();
+	d->active = proc;
+	d->queue_slots += now - proc->blocked_since;
+	d->busy_slots += proc->io_latency;
+	timer_at(now + proc->io_latency, io_complete, d);
+}
+
+/* The request in service on device [arg] has completed */
+static void io_complete(void * arg) {
+	struct io_dev * d = (struct io_dev *)arg;
+	struct pcb_t * proc;
+	pthread_mutex_lock(&io_lock);
+	proc = d->active;
+	d->active = NULL;
+	if (!empty(&d->waiters))
+		io_start(d, dequeue(&d->waiters));
+	pthread_mutex_unlock(&io_lock);
+	proc->block_time += current_time() - proc->blocked_since;
+	wake_proc(proc->last_cpu, proc);
+	atomic_fetch_sub(&nr_io, 1);
+	if (ready_notify != NULL)
+		ready_notify(proc->last_cpu);
+}
+
+int io_submit(int cpu, struct pcb_t * proc, uint32_t dev, uint32_t latency) {
+	struct io_dev * d;
+	if (dev >= MAX_IO_DEV)
+		return -1;
+	d = &io_devs[dev];
+	proc->blocked_since = current_time();
+	proc->io_latency = latency > 0 ? latency : 1;
+	block_proc(cpu, proc);
+	atomic_fetch_add(&nr_io, 1);
+	sched_lock(&io_lock, cpu);
+	d->used = 1;
+	d->nr_requests++;
+	if (d->active == NULL) {
+		io_start(d, proc);
+	}else{
+		enqueue(&d->waiters, proc);
+	}
+	pthread_mutex_unlock(&io_lock);
+	return 1;
+}
+
+/* The sleep of [arg] is over */
+static void sleep_done(void * arg) {
+	struct pcb_t * proc = (struct pcb_t *)arg;
+	proc->block_time += current_time() - proc->blocked_since;
+	wake_proc(proc->last_cpu, proc);
+	atomic_fetch_sub(&nr_sleeping, 1);
+	if (ready_notify != NULL)
+		ready_notify(proc->last_cpu);
+}
+
+int sched_sleep(int cpu, struct pcb_t * proc, uint32_t slots) {
+	if (slots == 0)
+		return 0;
+	proc->blocked_since = current_time();
+	block_proc(cpu, proc);
+	atomic_fetch_add(&nr_sleeping, 1);
+	atomic_fetch_add(&nr_sleeps, 1);
+	timer_at(current_time() + slots, sleep_done, proc);
+	return 1;
+}
+
+void set_ready_notify(void (*fn)(int cpu)) {
+	ready_notify = fn;
+}
+
+/* When every live process is blocked on an object, no I/O is in flight
+ * and nobody sleeps, nobody is left to wake them */
+int sched_pending(void) {
+	int blocked = atomic_load(&nr_blocked);
+	return atomic_load(&nr_io) > 0 || atomic_load(&nr_sleeping) > 0
+		|| (blocked > 0 && blocked < atomic_load(&nr_live));
+}
 
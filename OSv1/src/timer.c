@@ -1,9 +1,19 @@
 
 #include "timer.h"
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
-static pthread_t _timer;
+/* Number of polls of the barrier sense before a device blocks */
+#define TIMER_SPIN_LIMIT	4096
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	do { } while (0)
+#endif
 
 struct timer_id_container_t {
 	struct timer_id_t id;
@@ -15,65 +25,393 @@ static struct timer_id_container_t * dev_list = NULL;
 static uint64_t _time;
 
 static int timer_started = 0;
-static int timer_stop = 0;
 
+/* Sense-reversing tick barrier. Each device flips its local sense and
+ * arrives; the last one to arrive advances the clock and publishes the
+ * new sense, which releases everyone waiting on the current slot */
+static atomic_int nr_devs;	// Devices still attached to the clock
+static atomic_int nr_pending;	// Devices yet to finish the current slot
+static atomic_int tick_sense;
+static atomic_int nr_sleeping;	// Devices blocked on tick_cond
+static long host_cpus;
+static pthread_mutex_t tick_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tick_cond = PTHREAD_COND_INITIALIZER;
 
-static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		printf("Time slot %3lu\n", current_time());
-		int fsh = 0;
-		int event = 0;
-		/* Wait for all devices have done the job in current
-		 * time slot */
-		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
+/* Event-driven mode: the earliest slot in which some device has work,
+ * collected while devices arrive at the barrier */
+static int event_driven = 0;
+static _Atomic uint64_t next_wake = TIMER_IDLE;
+
+/* Devices sleeping until a later slot, sorted by wake time */
+static struct timer_id_t * sleep_list = NULL;
+static int nr_busy = 0;		// Sleeping devices that keep working
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Callbacks of timer_at live in a hierarchical timing wheel. Level l
+ * has WHEEL_SIZE buckets of WHEEL_SIZE^l slots each, and holds the
+ * callbacks which are in the same level l + 1 bucket as the wheel but not
+ * in the same level l one. Setting a callback is O(1). When the wheel
+ * enters a bucket of level l, the callbacks in it move down a level, so
+ * each one moves at most WHEEL_LEVELS - 1 times before it runs. Callbacks
+ * beyond the top level wait on an overflow list */
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_LEVELS	4
+
+struct timer_cb {
+	uint64_t when;
+	void (*fn)(void * arg);
+	void * arg;
+	struct timer_cb * next;
+};
+
+static struct timer_cb * wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t wheel_map[WHEEL_LEVELS];	// Non-empty buckets of each level
+static struct timer_cb * wheel_due;	// Set for a slot the wheel has passed
+static struct timer_cb * wheel_overflow;
+static struct timer_cb * cb_free;	// Nodes to reuse
+static uint64_t wheel_now;		// Slot the wheel has moved to
+static int nr_callbacks;		// Callbacks not run yet
+static unsigned long nr_cb_run;
+static unsigned long nr_cascades;	// Moves of a callback down a level
+static pthread_mutex_t cb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Statistics of the run */
+static uint64_t nr_ticks;
+static struct timespec start_ts;
+static struct timespec stop_ts;
+
+/* Insert [dev] into the sleep list, which is sorted by wake time. Called
+ * with sleep_lock held */
+static void sleep_insert(struct timer_id_t * dev) {
+	struct timer_id_t ** it;
+	for (it = &sleep_list; *it != NULL && (*it)->wake <= dev->wake;
+			it = &(*it)->next_sleeper);
+	dev->next_sleeper = *it;
+	*it = dev;
+}
+
+/* Put back on the clock every sleeping device whose wake time has come,
+ * they start the new slot with sense [sense]. The devices are moved to
+ * [woken] and must not run before the new slot is published */
+static void wake_sleepers(int sense, struct timer_id_t ** woken) {
+	pthread_mutex_lock(&sleep_lock);
+	while (sleep_list != NULL && sleep_list->wake <= _time) {
+		struct timer_id_t * dev = sleep_list;
+		sleep_list = dev->next_sleeper;
+		if (dev->busy) {
+			nr_busy--;
+		}
+		dev->sense = sense;
+		dev->next_sleeper = *woken;
+		*woken = dev;
+		atomic_fetch_add(&nr_devs, 1);
+	}
+	pthread_mutex_unlock(&sleep_lock);
+}
+
+/* Put [cb] in its bucket. Called with cb_lock held */
+static void wheel_place(struct timer_cb * cb) {
+	int l, i;
+	if (cb->when <= wheel_now) {
+		cb->next = wheel_due;
+		wheel_due = cb;
+		return;
+	}
+	for (l = 0; l < WHEEL_LEVELS; l++) {
+		if ((cb->when >> (WHEEL_BITS * (l + 1)))
+				== (wheel_now >> (WHEEL_BITS * (l + 1)))) {
+			i = (cb->when >> (WHEEL_BITS * l)) & (WHEEL_SIZE - 1);
+			cb->next = wheel[l][i];
+			wheel[l][i] = cb;
+			wheel_map[l] |= 1ULL << i;
+			return;
+		}
+	}
+	cb->next = wheel_overflow;
+	wheel_overflow = cb;
+}
+
+/* Empty bucket [i] of level [l], return its callbacks in the order they
+ * came in. Called with cb_lock held */
+static struct timer_cb * wheel_take(int l, int i) {
+	struct timer_cb * list = wheel[l][i], * rev = NULL;
+	wheel[l][i] = NULL;
+	wheel_map[l] &= ~(1ULL << i);
+	while (list != NULL) {
+		struct timer_cb * cb = list;
+		list = cb->next;
+		cb->next = rev;
+		rev = cb;
+	}
+	return rev;
+}
+
+/* Move the wheel to slot [to], which is not after any callback. The
+ * buckets of [to] come down a level by level, then the callbacks due in
+ * [to] are returned. Called with cb_lock held */
+static struct timer_cb * wheel_advance(uint64_t to) {
+	uint64_t from = wheel_now;
+	struct timer_cb * list, * due, ** tail;
+	int l;
+	wheel_now = to;
+	if ((from >> (WHEEL_BITS * WHEEL_LEVELS))
+			!= (to >> (WHEEL_BITS * WHEEL_LEVELS))) {
+		list = wheel_overflow;
+		wheel_overflow = NULL;
+		while (list != NULL) {
+			struct timer_cb * cb = list;
+			list = cb->next;
+			wheel_place(cb);
+			nr_cascades++;
+		}
+	}
+	for (l = WHEEL_LEVELS - 1; l > 0; l--) {
+		if ((from >> (WHEEL_BITS * l)) == (to >> (WHEEL_BITS * l)))
+			continue;
+		list = wheel_take(l, (to >> (WHEEL_BITS * l)) & (WHEEL_SIZE - 1));
+		while (list != NULL) {
+			struct timer_cb * cb = list;
+			list = cb->next;
+			wheel_place(cb);
+			nr_cascades++;
+		}
+	}
+	/* Late ones first, they were due before [to] */
+	due = wheel_due;
+	wheel_due = NULL;
+	for (tail = &due; *tail != NULL; tail = &(*tail)->next);
+	*tail = wheel_take(0, to & (WHEEL_SIZE - 1));
+	return due;
+}
+
+/* Slot of the first pending callback, TIMER_IDLE if there is none. The
+ * levels are in order of time, so the first non-empty bucket after the
+ * wheel on the lowest level holds it */
+static uint64_t next_callback(void) {
+	uint64_t when = TIMER_IDLE;
+	struct timer_cb * cb = NULL;
+	int l;
+	pthread_mutex_lock(&cb_lock);
+	if (nr_callbacks == 0) {
+		/* Nothing to look for */
+	}else if (wheel_due != NULL) {
+		when = wheel_now;
+	}else{
+		for (l = 0; l < WHEEL_LEVELS && cb == NULL; l++) {
+			int cur = (wheel_now >> (WHEEL_BITS * l)) & (WHEEL_SIZE - 1);
+			uint64_t map = cur == WHEEL_SIZE - 1
+				? 0 : wheel_map[l] & (~0ULL << (cur + 1));
+			if (map != 0) {
+				cb = wheel[l][__builtin_ctzll(map)];
 			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
 		}
+		if (cb == NULL) {
+			cb = wheel_overflow;
+		}
+		for (; cb != NULL; cb = cb->next) {
+			if (cb->when < when)
+				when = cb->when;
+		}
+	}
+	pthread_mutex_unlock(&cb_lock);
+	return when;
+}
 
-		/* Increase the time slot */
-		_time++;
-		
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
-			pthread_mutex_unlock(&temp->id.timer_lock);
+static int pending_callbacks(void) {
+	int n;
+	pthread_mutex_lock(&cb_lock);
+	n = nr_callbacks;
+	pthread_mutex_unlock(&cb_lock);
+	return n;
+}
+
+/* Call every callback whose slot has come. A callback may set new ones,
+ * those due at once run as well */
+static void run_callbacks(void) {
+	struct timer_cb * list;
+	pthread_mutex_lock(&cb_lock);
+	list = wheel_advance(_time);
+	pthread_mutex_unlock(&cb_lock);
+	while (list != NULL) {
+		struct timer_cb * cb = list;
+		list = cb->next;
+		cb->fn(cb->arg);
+		pthread_mutex_lock(&cb_lock);
+		cb->next = cb_free;
+		cb_free = cb;
+		nr_callbacks--;
+		nr_cb_run++;
+		if (list == NULL) {
+			list = wheel_due;
+			wheel_due = NULL;
+		}
+		pthread_mutex_unlock(&cb_lock);
+	}
+}
+
+/* Wake time of the first sleeping device, TIMER_IDLE if none. If [busy]
+ * is not NULL, store in it whether a busy device sleeps */
+static uint64_t first_sleeper(int * busy) {
+	uint64_t wake;
+	pthread_mutex_lock(&sleep_lock);
+	wake = sleep_list != NULL ? sleep_list->wake : TIMER_IDLE;
+	if (busy != NULL) {
+		*busy = nr_busy > 0;
+	}
+	pthread_mutex_unlock(&sleep_lock);
+	return wake;
+}
+
+/* Move the clock to the next slot, which has sense [sense]. Called by the
+ * last device arriving at the barrier, so no other device runs in the
+ * meantime. Return the sleeping devices that resume in the new slot */
+static struct timer_id_t * timer_tick(int sense) {
+	struct timer_id_t * woken = NULL;
+	uint64_t wake = atomic_exchange(&next_wake, TIMER_IDLE);
+	uint64_t when;
+	int busy;
+	while (1) {
+		when = first_sleeper(&busy);
+		if (when < wake) {
+			wake = when;
+		}
+		if (event_driven) {
+			when = next_callback();
+			if (when < wake) {
+				wake = when;
+			}
 		}
-		if (fsh == event) {
+		if (event_driven && !busy
+				&& wake != TIMER_IDLE && wake > _time + 1) {
+			/* Nobody has work before [wake], skip the empty slots */
+			_time = wake;
+		}else{
+			_time++;
+		}
+		nr_ticks++;
+		run_callbacks();
+		wake_sleepers(sense, &woken);
+		if (atomic_load(&nr_devs) > 0 || (first_sleeper(NULL)
+				== TIMER_IDLE && pending_callbacks() == 0))
 			break;
+		/* Every device sleeps through this slot */
+		printf("Time slot %3lu\n", current_time());
+		wake = TIMER_IDLE;
+	}
+	if (atomic_load(&nr_devs) > 0) {
+		printf("Time slot %3lu\n", current_time());
+	}else{
+		clock_gettime(CLOCK_MONOTONIC, &stop_ts);
+	}
+	atomic_store(&nr_pending, atomic_load(&nr_devs));
+	return woken;
+}
+
+static void tick_wait(int sense) {
+	/* Spinning only pays off when every device on the clock has a host
+	 * CPU of its own, otherwise the spinners steal time from the last
+	 * arrival. Parked and sleeping devices do not count */
+	int spin_limit = atomic_load(&nr_devs) <= host_cpus ? TIMER_SPIN_LIMIT : 0;
+	int i;
+	for (i = 0; i < spin_limit; i++) {
+		if (atomic_load_explicit(&tick_sense, memory_order_acquire) == sense)
+			return;
+		cpu_relax();
+	}
+	pthread_mutex_lock(&tick_lock);
+	atomic_fetch_add(&nr_sleeping, 1);
+	while (atomic_load(&tick_sense) != sense) {
+		pthread_cond_wait(&tick_cond, &tick_lock);
+	}
+	atomic_fetch_sub(&nr_sleeping, 1);
+	pthread_mutex_unlock(&tick_lock);
+}
+
+/* Report that [timer_id] has done its job in the current slot and has
+ * nothing to do before [wake]. A [busy] device keeps working through the
+ * slots it sleeps. If [leave] is set, the device also leaves the clock
+ * and does not wait */
+static void tick_arrive(struct timer_id_t * timer_id, uint64_t wake,
+		int busy, int leave) {
+	int sense = !timer_id->sense;
+	int sleep = !leave && wake != TIMER_IDLE && wake > _time + 1;
+	timer_id->sense = sense;
+	if (leave) {
+		atomic_fetch_sub(&nr_devs, 1);
+	}else if (sleep) {
+		/* Leave the barrier until [wake] */
+		atomic_store(&timer_id->asleep, 1);
+		pthread_mutex_lock(&sleep_lock);
+		timer_id->wake = wake;
+		timer_id->busy = busy;
+		sleep_insert(timer_id);
+		if (busy) {
+			nr_busy++;
+		}
+		pthread_mutex_unlock(&sleep_lock);
+		atomic_fetch_sub(&nr_devs, 1);
+	}else{
+		uint64_t cur = atomic_load(&next_wake);
+		while (wake < cur
+			&& !atomic_compare_exchange_weak(&next_wake, &cur, wake));
+	}
+	if (atomic_fetch_sub(&nr_pending, 1) == 1) {
+		/* Last one in: move to the next slot and release the others */
+		struct timer_id_t * woken = timer_tick(sense);
+		atomic_store(&tick_sense, sense);
+		if (atomic_load(&nr_sleeping) > 0 || woken != NULL) {
+			pthread_mutex_lock(&tick_lock);
+			pthread_cond_broadcast(&tick_cond);
+			while (woken != NULL) {
+				struct timer_id_t * dev = woken;
+				woken = dev->next_sleeper;
+				atomic_store(&dev->asleep, 0);
+				pthread_cond_signal(&dev->wake_cond);
+			}
+			pthread_mutex_unlock(&tick_lock);
 		}
+	}else if (!leave && !sleep) {
+		tick_wait(sense);
+	}
+	if (sleep) {
+		wait_event(timer_id);
 	}
-	pthread_exit(args);
 }
 
 void next_slot(struct timer_id_t * timer_id) {
-	/* Tell to timer that we have done our job in current slot */
-	pthread_mutex_lock(&timer_id->event_lock);
-	timer_id->done = 1;
-	pthread_cond_signal(&timer_id->event_cond);
-	pthread_mutex_unlock(&timer_id->event_lock);
-
-	/* Wait for going to next slot */
-	pthread_mutex_lock(&timer_id->timer_lock);
-	while (timer_id->done) {
-		pthread_cond_wait(
-			&timer_id->timer_cond,
-			&timer_id->timer_lock
-		);
+	/* Tell to timer that we have done our job in current slot and
+	 * wait for going to next slot */
+	tick_arrive(timer_id, current_time() + 1, 1, 0);
+}
+
+void next_slot_until(struct timer_id_t * timer_id, uint64_t wake) {
+	tick_arrive(timer_id, wake, 0, 0);
+}
+
+void next_slot_busy(struct timer_id_t * timer_id, uint64_t wake) {
+	tick_arrive(timer_id, wake, 1, 0);
+}
+
+void timer_at(uint64_t when, void (*fn)(void * arg), void * arg) {
+	struct timer_cb * cb;
+	pthread_mutex_lock(&cb_lock);
+	cb = cb_free;
+	if (cb != NULL) {
+		cb_free = cb->next;
+	}else{
+		cb = (struct timer_cb *)malloc(sizeof(struct timer_cb));
 	}
-	pthread_mutex_unlock(&timer_id->timer_lock);
+	cb->when = when;
+	cb->fn = fn;
+	cb->arg = arg;
+	wheel_place(cb);
+	nr_callbacks++;
+	pthread_mutex_unlock(&cb_lock);
+}
+
+void set_event_driven(int enable) {
+	event_driven = enable;
 }
 
 uint64_t current_time() {
@@ -82,55 +420,98 @@ uint64_t current_time() {
 
 void start_timer() {
 	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+	host_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	atomic_store(&nr_pending, atomic_load(&nr_devs));
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+	printf("Time slot %3lu\n", current_time());
+}
+
+/* Put [dev] on the sleep list until the next slot. A timer_at callback
+ * may do it while the clock moves, before the devices due in the new
+ * slot are woken, so [dev] does not always go at the head. Called with
+ * sleep_lock held */
+static void sleep_until_next(struct timer_id_t * dev) {
+	dev->wake = _time + 1;
+	dev->busy = 0;
+	atomic_store(&dev->asleep, 1);
+	sleep_insert(dev);
 }
 
 void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
 	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
+	tick_arrive(event, TIMER_IDLE, 0, 1);
 }
 
 struct timer_id_t * attach_event() {
+	struct timer_id_container_t * container =
+		(struct timer_id_container_t*)malloc(
+			sizeof(struct timer_id_container_t)
+		);
+	container->id.fsh = 0;
+	container->id.sense = 0;
+	atomic_init(&container->id.asleep, 0);
+	container->id.busy = 0;
+	container->id.next_sleeper = NULL;
+	pthread_cond_init(&container->id.wake_cond, NULL);
+	pthread_mutex_lock(&sleep_lock);
+	container->next = dev_list;
+	dev_list = container;
 	if (timer_started) {
-		return NULL;
+		/* The current slot is already under way, so the device sleeps
+		 * until the next one like any other sleeper */
+		sleep_until_next(&container->id);
 	}else{
-		struct timer_id_container_t * container =
-			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
-			);
-		container->id.done = 0;
-		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
-		if (dev_list == NULL) {
-			dev_list = container;
-			dev_list->next = NULL;
-		}else{
-			container->next = dev_list;
-			dev_list = container;
-		}
-		return &(container->id);
+		atomic_fetch_add(&nr_devs, 1);
+	}
+	pthread_mutex_unlock(&sleep_lock);
+	return &(container->id);
+}
+
+void park_event(struct timer_id_t * event) {
+	atomic_store(&event->asleep, 1);
+	tick_arrive(event, TIMER_IDLE, 0, 1);
+}
+
+void unpark_event(struct timer_id_t * event) {
+	pthread_mutex_lock(&sleep_lock);
+	sleep_until_next(event);
+	pthread_mutex_unlock(&sleep_lock);
+}
+
+void wait_event(struct timer_id_t * event) {
+	pthread_mutex_lock(&tick_lock);
+	while (atomic_load(&event->asleep)) {
+		pthread_cond_wait(&event->wake_cond, &tick_lock);
 	}
+	pthread_mutex_unlock(&tick_lock);
 }
 
 void stop_timer() {
-	timer_stop = 1;
-	pthread_join(_timer, NULL);
 	while (dev_list != NULL) {
 		struct timer_id_container_t * temp = dev_list;
 		dev_list = dev_list->next;
-		pthread_cond_destroy(&temp->id.event_cond);
-		pthread_mutex_destroy(&temp->id.event_lock);
-		pthread_cond_destroy(&temp->id.timer_cond);
-		pthread_mutex_destroy(&temp->id.timer_lock);
+		pthread_cond_destroy(&temp->id.wake_cond);
 		free(temp);
 	}
+	while (cb_free != NULL) {
+		struct timer_cb * cb = cb_free;
+		cb_free = cb->next;
+		free(cb);
+	}
 }
 
+double timer_elapsed(void) {
+	return (stop_ts.tv_sec - start_ts.tv_sec)
+		+ (stop_ts.tv_nsec - start_ts.tv_nsec) / 1e9;
+}
 
-
+void print_timer_stat(void) {
+	double secs = timer_elapsed();
+	printf("Timer: %lu ticks in %.3f s (%.0f ticks/sec)\n",
+		nr_ticks, secs, secs > 0 ? nr_ticks / secs : 0.0);
+	if (nr_cb_run > 0) {
+		printf("Timer wheel: %lu callbacks run, %lu moved down a level\n",
+			nr_cb_run, nr_cascades);
+	}
+}
 